@@ -13,6 +13,7 @@
  */
 #include <libcflat.h>
 #include <errata.h>
+#include <trace.h>
 #include <asm/setup.h>
 #include <asm/processor.h>
 #include <asm/delay.h>
@@ -159,6 +160,8 @@ static void irq_handler(struct pt_regs *regs __unused)
 	u32 irqnr = gic_iar_irqnr(irqstat);
 	int this_cpu = smp_processor_id();
 
+	trace("irq", irqnr, gic_get_sender(irqstat));
+
 	if (irqnr != GICC_INT_SPURIOUS) {
 		gic_write_eoir(irqstat);
 		irq_sender[this_cpu] = gic_get_sender(irqstat);
@@ -244,6 +247,7 @@ static void ipi_test_self(void)
 	stats_reset();
 	cpumask_clear(&mask);
 	cpumask_set_cpu(this_cpu, &mask);
+	trace("ipi-send-self", IPI_IRQ, this_cpu);
 	gic->ipi.send_self();
 	wait_for_interrupts(&mask);
 	report(check_acked(&mask, this_cpu, IPI_IRQ), "Interrupts received");
@@ -261,6 +265,7 @@ static void ipi_test_smp(void)
 	cpumask_copy(&mask, &cpu_present_mask);
 	for (i = this_cpu & 1; i < nr_cpus; i += 2)
 		cpumask_clear_cpu(i, &mask);
+	trace("ipi-send-mask", IPI_IRQ, cpumask_bits(&mask)[0]);
 	gic_ipi_send_mask(IPI_IRQ, &mask);
 	wait_for_interrupts(&mask);
 	report(check_acked(&mask, this_cpu, IPI_IRQ), "Interrupts received");
@@ -270,6 +275,7 @@ static void ipi_test_smp(void)
 	stats_reset();
 	cpumask_copy(&mask, &cpu_present_mask);
 	cpumask_clear_cpu(this_cpu, &mask);
+	trace("ipi-send-broadcast", IPI_IRQ, this_cpu);
 	gic->ipi.send_broadcast();
 	wait_for_interrupts(&mask);
 	report(check_acked(&mask, this_cpu, IPI_IRQ), "Interrupts received");
@@ -962,6 +968,8 @@ do_migrate:
 
 int main(int argc, char **argv)
 {
+	trace_enable_env();
+
 	if (!gic_init()) {
 		printf("No supported gic present, skipping tests...\n");
 		return report_summary();
@@ -0,0 +1,19 @@
+/*
+ * Spinlock contention benchmark, see lib/lock_bench.h.
+ *
+ * On arm the locks spin with YIELD, and with "-nopause" without it.
+ * Unlike spinlock-test, which checks the ldrex/strex based spin_lock(),
+ * this measures the locks.  Times are in ticks of the virtual counter.
+ *
+ * usage: lock-bench.flat [--json|--csv] [--pause|--nopause] [tas|ticket|mcs...]
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <lock_bench.h>
+#include <asm/setup.h>
+
+int main(int argc, char **argv)
+{
+	return lock_bench_main("lock-bench", nr_cpus, argc, argv);
+}
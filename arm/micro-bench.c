@@ -19,6 +19,8 @@
  * This work is licensed under the terms of the GNU LGPL, version 2.
  */
 #include <libcflat.h>
+#include <bench.h>
+#include <histogram.h>
 #include <util.h>
 #include <asm/gic.h>
 #include <asm/gic-v3-its.h>
@@ -346,10 +348,19 @@ static void ticks_to_ns_time(uint64_t ticks, struct ns_time *ns_time)
 	ns_time->ns_frac = (ps % 1000) / 100;
 }
 
+static struct histogram hist;
+
 static void loop_test(struct exit_test *test)
 {
-	uint64_t start, end, total_ticks, ntimes = 0;
+	uint64_t start, end, ticks, total_ticks, ntimes = 0;
 	struct ns_time avg_ns, total_ns = {};
+	struct bench_result r = {
+		.suite = "micro-bench",
+		.name = test->name,
+		.cpu = -1,
+		.freq = cntfrq,
+		.hist = &hist,
+	};
 
 	total_ticks = 0;
 	if (test->prep) {
@@ -359,6 +370,7 @@ static void loop_test(struct exit_test *test)
 		}
 	}
 
+	hist_init(&hist);
 	while (ntimes < test->times && total_ns.ns < NS_5_SECONDS) {
 		isb();
 		start = read_sysreg(cntpct_el0);
@@ -369,6 +381,11 @@ static void loop_test(struct exit_test *test)
 		ntimes++;
 		total_ticks += (end - start);
 		ticks_to_ns_time(total_ticks, &total_ns);
+
+		ticks = end - start;
+		if (test->post)
+			test->post(1, &ticks);
+		hist_add(&hist, ticks);
 	}
 
 	if (test->post) {
@@ -381,6 +398,10 @@ static void loop_test(struct exit_test *test)
 
 	printf("%-30s%15" PRId64 ".%-15" PRId64 "%15" PRId64 ".%-15" PRId64 "\n",
 		test->name, total_ns.ns, total_ns.ns_frac, avg_ns.ns, avg_ns.ns_frac);
+
+	r.iterations = ntimes;
+	r.ticks = total_ticks;
+	bench_emit(&r);
 }
 
 static void parse_args(int argc, char **argv)
@@ -389,6 +410,9 @@ static void parse_args(int argc, char **argv)
 	long val;
 
 	for (i = 1; i < argc; ++i) {
+		if (bench_parse_arg(argv[i]))
+			continue;
+
 		len = parse_keyval(argv[i], &val);
 		if (len == -1)
 			continue;
@@ -0,0 +1,310 @@
+/*
+ * virtio-blk throughput and latency benchmark.
+ *
+ * Keeps a fixed number of requests in flight against a virtio-blk disk
+ * for a fixed time, refilling the queue from the used ring by busy
+ * polling and notifying the device once per batch of refills.  For each
+ * job it reports IOPS, bandwidth and the latency distribution of the
+ * requests, from submission to the guest seeing them completed, so the
+ * numbers mostly reflect the host's virtio-blk, iothread and block layer
+ * paths.  The disk is a scratch image whose contents are overwritten;
+ * unittests.cfg has the runner create a 64M one for each run.  For
+ * stable numbers use cache=none,aio=native and an iothread in
+ * extra_params rather than the page cache backed default.
+ *
+ * Without job options a fixed set of jobs is run, otherwise the one
+ * described by:
+ *
+ *   qd=N       requests in flight (default 1, at most 42)
+ *   bs=N       bytes per request, a multiple of 512 (default 4096)
+ *   read=N     percentage of reads, the rest are writes (default 100)
+ *   seq=1      sequential instead of random offsets
+ *
+ * and for all jobs
+ *
+ *   ms=N       duration of a job in milliseconds (default 1000)
+ *   size=N     MB at the start of the disk to use (default: all of it)
+ *
+ * usage: virtio-blk-bench.flat [--json|--csv] [qd=N] [bs=N] [read=N] [seq=1] [ms=N] [size=N]
+ *
+ * The --json and --csv records carry, for each job, the latency of the
+ * requests under the job's name and the wall time per request under
+ * "<name>-wall".  Times are in ticks of the virtual counter.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <alloc_page.h>
+#include <bench.h>
+#include <bitops.h>
+#include <histogram.h>
+#include <util.h>
+#include <virtio.h>
+#include <virtio-blk.h>
+#include <asm/barrier.h>
+#include <asm/page.h>
+#include <asm/processor.h>
+
+#define SECTOR_SIZE		VIRTIO_BLK_SECTOR_SIZE
+/* Each read or write takes three descriptors of the 128 entry queue */
+#define MAX_QD			42
+
+struct job {
+	const char *name;
+	unsigned int qd;
+	unsigned int bs;
+	unsigned int read;	/* percentage of reads */
+	bool seq;
+};
+
+static struct job default_jobs[] = {
+	{ "randread-4k-qd1", 1, 4096, 100, false },
+	{ "randread-4k-qd32", 32, 4096, 100, false },
+	{ "randwrite-4k-qd32", 32, 4096, 0, false },
+	{ "randrw70-4k-qd16", 16, 4096, 70, false },
+	{ "seqread-128k-qd8", 8, 131072, 100, true },
+	{ "seqwrite-128k-qd8", 8, 131072, 0, true },
+};
+
+static struct virtio_blk *blk;
+static struct virtio_blk_req *reqs;
+static u64 hz, duration, sectors;
+
+static u64 rand_state = 0x9e3779b97f4a7c15ull;
+
+static u64 rand64(void)
+{
+	/* xorshift64 */
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return rand_state;
+}
+
+struct job_state {
+	const struct job *job;
+	u64 next;		/* next sector of a sequential job */
+	u64 blocks;		/* number of bs sized blocks in the region */
+};
+
+static void issue(struct job_state *s, struct virtio_blk_req *req, void *buf)
+{
+	const struct job *job = s->job;
+	u64 block;
+	u32 type;
+
+	if (job->seq) {
+		block = s->next++;
+		if (s->next == s->blocks)
+			s->next = 0;
+	} else {
+		block = rand64() % s->blocks;
+	}
+
+	type = rand64() % 100 < job->read ? VIRTIO_BLK_T_IN : VIRTIO_BLK_T_OUT;
+
+	req->start = get_cntvct();
+	if (virtio_blk_submit(blk, req, type, block * (job->bs / SECTOR_SIZE),
+			      buf, job->bs) < 0)
+		report_abort("virtqueue full with %u requests in flight", job->qd);
+}
+
+static void emit_result(const char *name, u64 iterations, u64 ticks,
+			const struct histogram *hist)
+{
+	struct bench_result r = {
+		.suite = "virtio-blk-bench",
+		.name = name,
+		.cpu = -1,
+		.iterations = iterations,
+		.ticks = ticks,
+		.freq = hz,
+		.hist = hist,
+	};
+
+	bench_emit(&r);
+}
+
+static void run_job(const struct job *job)
+{
+	struct job_state s = { .job = job };
+	u64 start, deadline, elapsed, now, bytes = 0, errors = 0;
+	struct virtio_blk_req *req;
+	unsigned int i, inflight, refilled;
+	struct histogram lat;
+	char wall[64];
+	u8 *bufs;
+
+	s.blocks = sectors / (job->bs / SECTOR_SIZE);
+	if (!s.blocks) {
+		report_skip("%s: disk smaller than one block", job->name);
+		return;
+	}
+
+	bufs = alloc_pages(get_order(job->qd * job->bs));
+	assert(bufs);
+
+	hist_init(&lat);
+
+	start = get_cntvct();
+	deadline = start + duration;
+
+	for (i = 0; i < job->qd; i++)
+		issue(&s, &reqs[i], bufs + i * job->bs);
+	virtio_blk_kick(blk);
+	inflight = job->qd;
+
+	while (inflight) {
+		refilled = 0;
+		while ((req = virtio_blk_complete(blk))) {
+			now = get_cntvct();
+			hist_add(&lat, now - req->start);
+			bytes += req->len;
+			errors += req->status != VIRTIO_BLK_S_OK;
+			if (now < deadline) {
+				issue(&s, req, req->data);
+				refilled++;
+			} else {
+				inflight--;
+			}
+		}
+		if (refilled)
+			virtio_blk_kick(blk);
+		else
+			cpu_relax();
+	}
+	elapsed = get_cntvct() - start;
+
+	free_pages(bufs);
+
+	report(errors == 0, "%s", job->name);
+	if (errors)
+		report_info("%s: %" PRIu64 " requests failed", job->name, errors);
+
+	printf("  %s iops %" PRIu64 " KiB/s %" PRIu64 "\n", job->name,
+	       lat.count * hz / elapsed, bytes / 1024 * hz / elapsed);
+	printf("  %s latency-ns min %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64
+	       " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 "\n", job->name,
+	       bench_ticks_to_ns(lat.min, hz),
+	       bench_ticks_to_ns(hist_permille(&lat, 500), hz),
+	       bench_ticks_to_ns(hist_permille(&lat, 900), hz),
+	       bench_ticks_to_ns(hist_permille(&lat, 990), hz),
+	       bench_ticks_to_ns(hist_permille(&lat, 999), hz),
+	       bench_ticks_to_ns(lat.max, hz));
+
+	if (bench_get_format() == BENCH_FMT_TEXT)
+		return;
+
+	snprintf(wall, sizeof(wall), "%s-wall", job->name);
+	emit_result(job->name, lat.count, lat.sum, &lat);
+	emit_result(wall, lat.count, elapsed, NULL);
+}
+
+/* Write a pattern, read it back and flush, before trusting any numbers */
+static void check_io(void)
+{
+	u8 *buf = alloc_page();
+	bool ok;
+	int i;
+
+	assert(buf);
+	for (i = 0; i < PAGE_SIZE; i++)
+		buf[i] = i ^ 0x5a;
+
+	ok = virtio_blk_io(blk, VIRTIO_BLK_T_OUT, 0, buf, PAGE_SIZE) == VIRTIO_BLK_S_OK;
+	memset(buf, 0, PAGE_SIZE);
+	ok = ok && virtio_blk_io(blk, VIRTIO_BLK_T_IN, 0, buf, PAGE_SIZE) == VIRTIO_BLK_S_OK;
+	for (i = 0; ok && i < PAGE_SIZE; i++)
+		ok = buf[i] == (u8)(i ^ 0x5a);
+	report(ok, "read back written data");
+
+	if (virtio_has_feature(blk->vdev, VIRTIO_BLK_F_FLUSH))
+		report(virtio_blk_io(blk, VIRTIO_BLK_T_FLUSH, 0, NULL, 0) == VIRTIO_BLK_S_OK,
+		       "flush");
+
+	free_page(buf);
+}
+
+int main(int argc, char **argv)
+{
+	struct job custom = { "custom", 1, 4096, 100, false };
+	bool have_custom = false;
+	long val, ms = 1000, size = 0;
+	static char name[64];
+	int i, len;
+
+	for (i = 1; i < argc; ++i) {
+		if (bench_parse_arg(argv[i]))
+			continue;
+
+		len = parse_keyval(argv[i], &val);
+		if (len == -1 || val < 0)
+			report_abort("invalid argument '%s'", argv[i]);
+		argv[i][len] = '\0';
+
+		if (strcmp(argv[i], "ms") == 0) {
+			ms = val;
+			continue;
+		} else if (strcmp(argv[i], "size") == 0) {
+			size = val;
+			continue;
+		}
+
+		if (strcmp(argv[i], "qd") == 0)
+			custom.qd = val;
+		else if (strcmp(argv[i], "bs") == 0)
+			custom.bs = val;
+		else if (strcmp(argv[i], "read") == 0)
+			custom.read = val;
+		else if (strcmp(argv[i], "seq") == 0)
+			custom.seq = val;
+		else
+			report_abort("unknown argument '%s'", argv[i]);
+		have_custom = true;
+	}
+
+	if (custom.qd < 1 || custom.qd > MAX_QD)
+		report_abort("qd must be between 1 and %d", MAX_QD);
+	if (!custom.bs || custom.bs % SECTOR_SIZE)
+		report_abort("bs must be a multiple of %d", SECTOR_SIZE);
+	if (custom.read > 100)
+		report_abort("read must be a percentage");
+
+	blk = virtio_blk_bind();
+	if (!blk) {
+		report_skip("no virtio-blk device");
+		return report_summary();
+	}
+
+	sectors = blk->capacity;
+	if (size)
+		sectors = MIN(sectors, (u64)size * 1024 * 1024 / SECTOR_SIZE);
+
+	hz = get_cntfrq();
+	duration = hz * ms / 1000;
+	printf("%" PRIu64 " MB disk, using %" PRIu64 " MB, %ld ms per job\n",
+	       blk->capacity * SECTOR_SIZE / 1024 / 1024,
+	       sectors * SECTOR_SIZE / 1024 / 1024, ms);
+
+	reqs = alloc_pages(get_order(MAX_QD * sizeof(*reqs)));
+	assert(reqs);
+
+	check_io();
+
+	if (have_custom) {
+		snprintf(name, sizeof(name), "%s%s-%ub-qd%u",
+			 custom.seq ? "seq" : "rand",
+			 custom.read == 100 ? "read" : custom.read ? "rw" : "write",
+			 custom.bs, custom.qd);
+		if (custom.read % 100)
+			snprintf(name + strlen(name), sizeof(name) - strlen(name),
+				 "-read%u", custom.read);
+		custom.name = name;
+		run_job(&custom);
+	} else {
+		for (i = 0; i < ARRAY_SIZE(default_jobs); i++)
+			run_job(&default_jobs[i]);
+	}
+
+	return report_summary();
+}
@@ -4,6 +4,7 @@
  * This work is licensed under the terms of the GNU LGPL, version 2.
  */
 #include "libcflat.h"
+#include "trace.h"
 
 /*
  * When exit(code) is invoked, qemu will exit with ((code << 1) | 1),
@@ -16,5 +17,6 @@
 
 void abort(void)
 {
+	trace_dump();
 	exit(ABORT_EXIT_STATUS);
 }
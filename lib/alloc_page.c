@@ -12,6 +12,7 @@
 #include "list.h"
 #include <asm/page.h>
 #include <asm/io.h>
+#include <asm/barrier.h>
 #include <asm/spinlock.h>
 #include <asm/memory_areas.h>
 
@@ -55,6 +56,29 @@ static unsigned int areas_mask;
 /* Protects areas and areas mask */
 static struct spinlock lock;
 
+/*
+ * Per-CPU caches of small blocks, so that CPUs allocating and freeing
+ * blocks of up to PCP_MAX_ORDER do not all serialize on the global lock.
+ * Cached blocks are still marked allocated in the area metadata; they are
+ * taken from and given back to the freelists PCP_BATCH blocks at a time.
+ * Each cache is kept in a singly linked list through the first word of
+ * its blocks and protected by its own lock, which is taken before the
+ * global one, so that caches can also be drained from other CPUs.
+ */
+#define PCP_MAX_ORDER	2
+#define PCP_BATCH	16
+#define PCP_HIGH	(4 * PCP_BATCH)
+
+struct page_cache {
+	struct spinlock lock;
+	void *blocks[PCP_MAX_ORDER + 1];
+	unsigned int count[PCP_MAX_ORDER + 1];
+} __attribute__((aligned(64)));
+
+static struct page_cache *page_caches;
+static unsigned int nr_page_caches;
+static int (*page_cache_cpu_id)(void);
+
 bool page_alloc_initialized(void)
 {
 	return areas_mask != 0;
@@ -220,6 +244,7 @@ static struct mem_area *get_area(pfn_t pfn)
 static bool coalesce(struct mem_area *a, u8 order, pfn_t pfn, pfn_t pfn2)
 {
 	pfn_t first, second, i;
+	u8 status;
 
 	assert(IS_ALIGNED_ORDER(pfn, order) && IS_ALIGNED_ORDER(pfn2, order));
 	assert(pfn2 == pfn + BIT(order));
@@ -230,20 +255,31 @@ static bool coalesce(struct mem_area *a, u8 order, pfn_t pfn, pfn_t pfn2)
 		return false;
 	first = pfn - a->base;
 	second = pfn2 - a->base;
+	/* the two blocks are not both free, cannot coalesce */
+	if (!IS_USABLE(a->page_states[first]) || !IS_USABLE(a->page_states[second]))
+		return false;
 	/* the two blocks have different sizes, cannot coalesce */
-	if ((a->page_states[first] != order) || (a->page_states[second] != order))
+	if (((a->page_states[first] & ORDER_MASK) != order) ||
+	    ((a->page_states[second] & ORDER_MASK) != order))
 		return false;
+	/* the new block is only fresh if both halves are */
+	status = a->page_states[first] | a->page_states[second];
+	status &= STATUS_MASK;
 
 	/* we can coalesce, remove both blocks from their freelists */
 	list_remove(pfn_to_virt(pfn2));
 	list_remove(pfn_to_virt(pfn));
 	/* check the metadata entries and update with the new size */
-	for (i = 0; i < (2ull << order); i++) {
-		assert(a->page_states[first + i] == order);
-		a->page_states[first + i] = order + 1;
+	for (i = 0; i < BIT(order); i++) {
+		assert(a->page_states[first + i] == a->page_states[first]);
+		assert(a->page_states[second + i] == a->page_states[second]);
 	}
+	memset(a->page_states + first, status | (order + 1), 2ull << order);
 	/* finally add the newly coalesced block to the appropriate freelist */
-	list_add(a->freelists + order + 1, pfn_to_virt(pfn));
+	if (IS_FRESH(status))
+		list_add_tail(a->freelists + order + 1, pfn_to_virt(pfn));
+	else
+		list_add(a->freelists + order + 1, pfn_to_virt(pfn));
 	if (order + 1 > a->max_order)
 		a->max_order = order + 1;
 	return true;
@@ -317,8 +353,100 @@ static void _free_pages(void *mem)
 	} while (coalesce(a, order, pfn, pfn2));
 }
 
+/*
+ * Returns the cache of the calling CPU, or NULL if its id is out of range,
+ * in which case the freelists are used directly.
+ */
+static struct page_cache *this_page_cache(void)
+{
+	unsigned int id = page_cache_cpu_id();
+
+	return id < nr_page_caches ? page_caches + id : NULL;
+}
+
+static void page_cache_push(struct page_cache *pc, u8 order, void *mem)
+{
+	*(void **)mem = pc->blocks[order];
+	pc->blocks[order] = mem;
+	pc->count[order]++;
+}
+
+static void *page_cache_pop(struct page_cache *pc, u8 order)
+{
+	void *mem = pc->blocks[order];
+
+	if (mem) {
+		pc->blocks[order] = *(void **)mem;
+		pc->count[order]--;
+	}
+	return mem;
+}
+
+/*
+ * Gives back up to n blocks of the given order to the freelists.
+ * The function is called with the lock of the cache held.
+ */
+static void page_cache_drain(struct page_cache *pc, u8 order, unsigned int n)
+{
+	void *mem;
+
+	spin_lock(&lock);
+	while (n-- && (mem = page_cache_pop(pc, order)))
+		_free_pages(mem);
+	spin_unlock(&lock);
+}
+
+/* Gives back the blocks of all CPUs' caches to the freelists. */
+static void page_cache_drain_all(void)
+{
+	unsigned int i;
+	u8 order;
+
+	for (i = 0; i < nr_page_caches; i++) {
+		spin_lock(&page_caches[i].lock);
+		for (order = 0; order <= PCP_MAX_ORDER; order++)
+			page_cache_drain(page_caches + i, order, -1u);
+		spin_unlock(&page_caches[i].lock);
+	}
+}
+
+/*
+ * Returns the order of the allocated block starting at mem if it can be
+ * put in a per-CPU cache, -1 otherwise. The metadata of an allocated
+ * block only changes when it is freed, so the lock is not needed.
+ */
+static int page_cache_order(void *mem)
+{
+	pfn_t pfn = virt_to_pfn(mem);
+	struct mem_area *a;
+	u8 state;
+
+	if (!page_caches || !IS_ALIGNED((uintptr_t)mem, PAGE_SIZE))
+		return -1;
+	a = get_area(pfn);
+	if (!a)
+		return -1;
+	state = a->page_states[pfn - a->base];
+	if (!IS_ALLOCATED(state) || (state & ORDER_MASK) > PCP_MAX_ORDER)
+		return -1;
+	return state & ORDER_MASK;
+}
+
 void free_pages(void *mem)
 {
+	struct page_cache *pc;
+	int order;
+
+	if (mem && (order = page_cache_order(mem)) >= 0 &&
+	    (pc = this_page_cache())) {
+		spin_lock(&pc->lock);
+		page_cache_push(pc, order, mem);
+		if (pc->count[order] > PCP_HIGH)
+			page_cache_drain(pc, order, PCP_BATCH);
+		spin_unlock(&pc->lock);
+		return;
+	}
+
 	spin_lock(&lock);
 	_free_pages(mem);
 	spin_unlock(&lock);
@@ -335,8 +463,8 @@ static int _reserve_one_page(pfn_t pfn)
 	i = pfn - a->base;
 	if (!IS_USABLE(a->page_states[i]))
 		return -1;
-	while (a->page_states[i]) {
-		mask = GENMASK_ULL(63, a->page_states[i]);
+	while (a->page_states[i] & ORDER_MASK) {
+		mask = GENMASK_ULL(63, a->page_states[i] & ORDER_MASK);
 		split(a, pfn_to_virt(pfn & mask));
 	}
 	a->page_states[i] = STATUS_SPECIAL;
@@ -363,6 +491,8 @@ int reserve_pages(phys_addr_t addr, size_t n)
 
 	assert(IS_ALIGNED(addr, PAGE_SIZE));
 	pfn = addr >> PAGE_SHIFT;
+	/* Free pages might be sitting in a per-CPU cache */
+	page_cache_drain_all();
 	spin_lock(&lock);
 	for (i = 0; i < n; i++)
 		if (_reserve_one_page(pfn + i))
@@ -389,18 +519,72 @@ void unreserve_pages(phys_addr_t addr, size_t n)
 	spin_unlock(&lock);
 }
 
-static void *page_memalign_order_flags(u8 al, u8 ord, u32 flags)
+/* The function is called with the lock held. */
+static void *_page_memalign_order_flags(u8 al, u8 ord, u32 flags)
 {
 	void *res = NULL;
 	int i, area, fresh;
 
 	fresh = !!(flags & FLAG_FRESH);
-	spin_lock(&lock);
 	area = (flags & AREA_MASK) ? flags & areas_mask : areas_mask;
 	for (i = 0; !res && (i < MAX_AREAS); i++)
 		if (area & BIT(i))
 			res = page_memalign_order(areas + i, al, ord, fresh);
-	spin_unlock(&lock);
+	return res;
+}
+
+/*
+ * Allocates a block of the given order from the per-CPU cache, refilling
+ * the cache from the freelists if it is empty.
+ */
+static void *page_cache_alloc(u8 ord)
+{
+	struct page_cache *pc = this_page_cache();
+	unsigned int n;
+	void *res;
+
+	if (!pc)
+		return NULL;
+
+	spin_lock(&pc->lock);
+	if (!pc->count[ord]) {
+		spin_lock(&lock);
+		for (n = 0; n < PCP_BATCH; n++) {
+			res = _page_memalign_order_flags(ord, ord, AREA_ANY);
+			if (!res)
+				break;
+			page_cache_push(pc, ord, res);
+		}
+		spin_unlock(&lock);
+	}
+	res = page_cache_pop(pc, ord);
+	spin_unlock(&pc->lock);
+	return res;
+}
+
+static void *page_memalign_order_flags(u8 al, u8 ord, u32 flags)
+{
+	bool cached = page_caches && al <= ord && ord <= PCP_MAX_ORDER &&
+		      !(flags & (AREA_MASK | FLAG_FRESH));
+	void *res = NULL;
+
+	if (cached)
+		res = page_cache_alloc(ord);
+
+	if (!res) {
+		spin_lock(&lock);
+		res = _page_memalign_order_flags(al, ord, flags);
+		spin_unlock(&lock);
+	}
+
+	if (!res && page_caches) {
+		/* The memory might be sitting in the per-CPU caches */
+		page_cache_drain_all();
+		spin_lock(&lock);
+		res = _page_memalign_order_flags(al, ord, flags);
+		spin_unlock(&lock);
+	}
+
 	if (res && !(flags & FLAG_DONTZERO))
 		memset(res, 0, BIT(ord) * PAGE_SIZE);
 	return res;
@@ -415,6 +599,61 @@ void *alloc_pages_flags(unsigned int order, unsigned int flags)
 	return page_memalign_order_flags(order, order, flags);
 }
 
+/*
+ * Takes up to n blocks of the given order from the freelists.
+ * The function is called with the lock held.
+ */
+static unsigned int _alloc_pages_bulk(u8 ord, u32 flags, unsigned int n, void **pages)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		pages[i] = _page_memalign_order_flags(ord, ord, flags);
+		if (!pages[i])
+			break;
+	}
+	return i;
+}
+
+/*
+ * Allocates up to n blocks of (1 << order) naturally aligned pages into
+ * pages, taking the lock only once.
+ * Returns the number of blocks allocated.
+ */
+unsigned int alloc_pages_bulk_flags(unsigned int order, unsigned int flags,
+				    unsigned int n, void **pages)
+{
+	size_t len, block = BIT(order) * PAGE_SIZE;
+	unsigned int i, nr;
+	char *start;
+
+	assert(order < NLISTS);
+	spin_lock(&lock);
+	nr = _alloc_pages_bulk(order, flags, n, pages);
+	spin_unlock(&lock);
+
+	if (nr < n && page_caches) {
+		/* The memory might be sitting in the per-CPU caches */
+		page_cache_drain_all();
+		spin_lock(&lock);
+		nr += _alloc_pages_bulk(order, flags, n - nr, pages + nr);
+		spin_unlock(&lock);
+	}
+
+	if (flags & FLAG_DONTZERO)
+		return nr;
+
+	/* Zero runs of physically adjacent blocks with a single memset. */
+	for (i = 0; i < nr; i += len / block) {
+		start = pages[i];
+		for (len = block; i + len / block < nr; len += block)
+			if (pages[i + len / block] != start + len)
+				break;
+		memset(start, 0, len);
+	}
+	return nr;
+}
+
 /*
  * Allocates (1 << order) physically contiguous aligned pages.
  * Returns NULL if the allocation was not possible.
@@ -430,6 +669,31 @@ void *memalign_pages_flags(size_t alignment, size_t size, unsigned int flags)
 }
 
 
+/*
+ * Enables the per-CPU caches.
+ *
+ * Prerequisites:
+ * - the page allocator has been initialized
+ * - cpu_id returns a number smaller than nr_cpus on every CPU; a CPU for
+ *   which it does not bypasses the caches
+ */
+void page_alloc_cpu_caches_enable(unsigned int nr_cpus, int (*cpu_id)(void))
+{
+	struct page_cache *caches;
+	size_t size = nr_cpus * sizeof(*caches);
+
+	assert(page_alloc_initialized() && !page_caches && nr_cpus);
+	caches = memalign_pages_flags(PAGE_SIZE, size, AREA_ANY);
+	assert(caches);
+
+	spin_lock(&lock);
+	nr_page_caches = nr_cpus;
+	page_cache_cpu_id = cpu_id;
+	smp_wmb();
+	page_caches = caches;
+	spin_unlock(&lock);
+}
+
 static struct alloc_ops page_alloc_ops = {
 	.memalign = memalign_pages,
 	.free = free_pages,
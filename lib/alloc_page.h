@@ -34,6 +34,14 @@ void page_alloc_init_area(u8 n, phys_addr_t base_pfn, phys_addr_t top_pfn);
 /* Enables the page allocator. At least one area must have been initialized */
 void page_alloc_ops_enable(void);
 
+/*
+ * Enables per-CPU caches of small blocks, which lets CPUs allocate and
+ * free them without contending on the allocator's global lock.
+ * nr_cpus is the number of caches to set up, cpu_id must return the index
+ * of the calling CPU's cache, smaller than nr_cpus.
+ */
+void page_alloc_cpu_caches_enable(unsigned int nr_cpus, int (*cpu_id)(void));
+
 /*
  * Allocate aligned memory with the specified flags.
  * flags is a bitmap of allowed areas and flags.
@@ -75,6 +83,28 @@ static inline void *alloc_page(void)
 	return alloc_pages(0);
 }
 
+/*
+ * Allocate up to n blocks of 1ull << order naturally aligned pages with
+ * the specified flags and store them in pages, taking the allocator lock
+ * only once. Unless FLAG_DONTZERO is given, the blocks are zeroed after
+ * the lock has been dropped, physically adjacent ones in one go.
+ * Returns the number of blocks allocated, which is smaller than n only if
+ * memory ran out. Each block must be freed with free_pages.
+ */
+unsigned int alloc_pages_bulk_flags(unsigned int order, unsigned int flags,
+				    unsigned int n, void **pages);
+
+/*
+ * Allocate up to n blocks of 1ull << order pages from any area and with
+ * default flags.
+ * Equivalent to alloc_pages_bulk_flags(order, AREA_ANY, n, pages);
+ */
+static inline unsigned int alloc_pages_bulk(unsigned int order, unsigned int n,
+					    void **pages)
+{
+	return alloc_pages_bulk_flags(order, AREA_ANY, n, pages);
+}
+
 /*
  * Frees a memory block allocated with any of the memalign_pages* or
  * alloc_pages* functions.
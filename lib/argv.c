@@ -61,6 +61,17 @@ void add_setup_arg(const char *arg)
 	++__argc;
 }
 
+/*
+ * Replace the arguments after argv[0] with args, e.g. when a test resumes
+ * from a snapshot taken before its command line was known.
+ */
+void replace_setup_args(const char *args)
+{
+	__argc = 1;
+	copy_ptr = __argv[0] + strlen(__argv[0]) + 1;
+	setup_args(args);
+}
+
 void setup_args_progname(const char *args)
 {
 	add_setup_arg(auxinfo.progname);
@@ -12,5 +12,6 @@ extern void __setup_args(void);
 extern void setup_args_progname(const char *args);
 extern void setup_env(char *env, int size);
 extern void add_setup_arg(const char *arg);
+extern void replace_setup_args(const char *args);
 
 #endif
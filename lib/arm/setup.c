@@ -19,6 +19,8 @@
 #include <vmalloc.h>
 #include <auxinfo.h>
 #include <argv.h>
+#include <trace.h>
+#include <bench.h>
 #include <asm/thread_info.h>
 #include <asm/setup.h>
 #include <asm/page.h>
@@ -236,6 +238,16 @@ static void timer_save_state(void)
 	__timer_state.vtimer.irq_flags = fdt32_to_cpu(data[8]);
 }
 
+static int cpu_id(void)
+{
+	return smp_processor_id();
+}
+
+static u64 read_cntfrq(void)
+{
+	return get_cntfrq();
+}
+
 void setup(const void *fdt, phys_addr_t freemem_start)
 {
 	void *freemem;
@@ -272,6 +284,9 @@ void setup(const void *fdt, phys_addr_t freemem_start)
 
 	/* cpu_init must be called before thread_info_init */
 	thread_info_init(current_thread_info(), 0);
+	page_alloc_cpu_caches_enable(nr_cpus, cpu_id);
+	trace_init(nr_cpus, cpu_id, get_cntvct, read_cntfrq);
+	bench_smp_init(cpu_id, get_cntvct, read_cntfrq, on_cpu_async);
 
 	/* mem_init must be called before io_init */
 	io_init();
@@ -1,18 +1,23 @@
 #ifndef _ASM_GENERIC_SPINLOCK_H_
 #define _ASM_GENERIC_SPINLOCK_H_
+/*
+ * struct spinlock is a fair ticket lock.  Locks that want a different
+ * algorithm can be declared with one of the other types from locks.h.
+ */
+#include <locks.h>
 
 struct spinlock {
-    unsigned int v;
+	struct ticket_spinlock ticket;
 };
 
 static inline void spin_lock(struct spinlock *lock)
 {
-	while (__sync_lock_test_and_set(&lock->v, 1));
+	ticket_spin_lock(&lock->ticket);
 }
 
 static inline void spin_unlock(struct spinlock *lock)
 {
-	__sync_lock_release(&lock->v);
+	ticket_spin_unlock(&lock->ticket);
 }
 
 #endif
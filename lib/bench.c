@@ -0,0 +1,218 @@
+/*
+ * Machine-readable benchmark results.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include "bench.h"
+#include "asm/barrier.h"
+
+#define NSEC_PER_SEC	1000000000ULL
+
+static enum bench_format bench_format = BENCH_FMT_TEXT;
+static bool format_set, csv_header_done;
+
+static struct {
+	int (*cpu_id)(void);
+	u64 (*clock)(void);
+	u64 (*hz)(void);
+	void (*on_cpu_async)(int cpu, void (*func)(void *data), void *data);
+} bench_smp;
+
+static void (*run_func)(void *data);
+static int run_cpus;
+static volatile int run_ready, run_done;
+static volatile u64 run_deadline;
+
+bool bench_parse_arg(const char *arg)
+{
+	if (strcmp(arg, "--json") == 0)
+		bench_format = BENCH_FMT_JSON;
+	else if (strcmp(arg, "--csv") == 0)
+		bench_format = BENCH_FMT_CSV;
+	else
+		return false;
+
+	format_set = true;
+	return true;
+}
+
+enum bench_format bench_get_format(void)
+{
+	const char *env;
+
+	if (!format_set) {
+		env = getenv("BENCH_FORMAT");
+		if (env && strcmp(env, "json") == 0)
+			bench_format = BENCH_FMT_JSON;
+		else if (env && strcmp(env, "csv") == 0)
+			bench_format = BENCH_FMT_CSV;
+		format_set = true;
+	}
+
+	return bench_format;
+}
+
+u64 bench_ticks_to_ns(u64 ticks, u64 freq)
+{
+	if (!freq)
+		return 0;
+
+	return ticks / freq * NSEC_PER_SEC +
+	       ticks % freq * NSEC_PER_SEC / freq;
+}
+
+u64 bench_rate(u64 count, u64 ticks, u64 freq)
+{
+	/* Drop low bits of the clock, rather than wrap count * freq */
+	while (freq && count > -1ull / freq) {
+		freq >>= 1;
+		ticks >>= 1;
+	}
+
+	return ticks ? count * freq / ticks : 0;
+}
+
+static void emit_json(const struct bench_result *r)
+{
+	const struct histogram *h = r->hist;
+
+	printf("BENCH: {\"schema\":%d,\"suite\":\"%s\",\"name\":\"%s\","
+	       "\"cpu\":%d,\"iterations\":%" PRIu64 ",\"ticks\":%" PRIu64
+	       ",\"freq\":%" PRIu64 ",",
+	       BENCH_SCHEMA_VERSION, r->suite, r->name, r->cpu,
+	       r->iterations, r->ticks, r->freq);
+
+	if (r->freq)
+		printf("\"ns\":%" PRIu64 ",",
+		       bench_ticks_to_ns(r->ticks, r->freq));
+	else
+		printf("\"ns\":null,");
+
+	if (h && h->count)
+		printf("\"min\":%" PRIu64 ",\"p50\":%" PRIu64
+		       ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64
+		       ",\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "}\n",
+		       h->min, hist_permille(h, 500), hist_permille(h, 900),
+		       hist_permille(h, 990), hist_permille(h, 999), h->max);
+	else
+		printf("\"min\":null,\"p50\":null,\"p90\":null,\"p99\":null,"
+		       "\"p999\":null,\"max\":null}\n");
+}
+
+static void emit_csv(const struct bench_result *r)
+{
+	const struct histogram *h = r->hist;
+
+	if (!csv_header_done) {
+		printf("BENCH-CSV: schema,suite,name,cpu,iterations,ticks,freq,"
+		       "ns,min,p50,p90,p99,p999,max\n");
+		csv_header_done = true;
+	}
+
+	printf("BENCH-CSV: %d,%s,%s,%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",",
+	       BENCH_SCHEMA_VERSION, r->suite, r->name, r->cpu,
+	       r->iterations, r->ticks, r->freq);
+
+	if (r->freq)
+		printf("%" PRIu64, bench_ticks_to_ns(r->ticks, r->freq));
+
+	if (h && h->count)
+		printf(",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+		       ",%" PRIu64 ",%" PRIu64 "\n",
+		       h->min, hist_permille(h, 500), hist_permille(h, 900),
+		       hist_permille(h, 990), hist_permille(h, 999), h->max);
+	else
+		printf(",,,,,,\n");
+}
+
+void bench_emit(const struct bench_result *r)
+{
+	switch (bench_get_format()) {
+	case BENCH_FMT_JSON:
+		emit_json(r);
+		break;
+	case BENCH_FMT_CSV:
+		emit_csv(r);
+		break;
+	default:
+		break;
+	}
+}
+
+void bench_emit_hist(const char *suite, const char *name, int cpu,
+		     const struct histogram *hist, u64 freq)
+{
+	struct bench_result r = {
+		.suite = suite,
+		.name = name,
+		.cpu = cpu,
+		.iterations = hist->count,
+		.ticks = hist->sum,
+		.freq = freq,
+		.hist = hist,
+	};
+
+	bench_emit(&r);
+}
+
+void bench_smp_init(int (*cpu_id)(void), u64 (*clock)(void), u64 (*hz)(void),
+		    void (*on_cpu_async)(int cpu, void (*func)(void *data),
+					 void *data))
+{
+	bench_smp.cpu_id = cpu_id;
+	bench_smp.clock = clock;
+	bench_smp.hz = hz;
+	bench_smp.on_cpu_async = on_cpu_async;
+}
+
+int bench_cpu_id(void)
+{
+	return bench_smp.cpu_id();
+}
+
+u64 bench_clock(void)
+{
+	return bench_smp.clock();
+}
+
+u64 bench_clock_hz(void)
+{
+	return bench_smp.hz();
+}
+
+static void run_secondary(void *data)
+{
+	run_func(data);
+	__sync_add_and_fetch(&run_done, 1);
+}
+
+void bench_run_on_first_cpus(int ncpus, void (*func)(void *data), void *data)
+{
+	int cpu;
+
+	run_func = func;
+	run_cpus = ncpus;
+	run_ready = 0;
+	run_done = 0;
+	run_deadline = 0;
+	smp_wmb();
+
+	for (cpu = ncpus - 1; cpu > 0; --cpu)
+		bench_smp.on_cpu_async(cpu, run_secondary, data);
+	func(data);
+
+	while (run_done < ncpus - 1)
+		cpu_relax();
+	smp_rmb();
+}
+
+u64 bench_wait_start(u64 duration)
+{
+	if (__sync_add_and_fetch(&run_ready, 1) == run_cpus)
+		run_deadline = bench_clock() + duration;
+	while (!run_deadline)
+		cpu_relax();
+
+	return run_deadline;
+}
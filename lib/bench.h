@@ -0,0 +1,94 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+/*
+ * Machine-readable benchmark results.
+ *
+ * Benchmarks describe each measurement with a struct bench_result and
+ * hand it to bench_emit(), which prints it on the console in the format
+ * selected on the command line or, failing that, by the BENCH_FORMAT
+ * environment variable ("json" or "csv").  Every record is a single line starting
+ * with "BENCH: " (JSON) or "BENCH-CSV: " (CSV) so that it can be picked
+ * out of the test log, see scripts/bench_collect.py.
+ *
+ * The record layout is versioned with BENCH_SCHEMA_VERSION; fields are
+ * only ever appended, never reordered or renamed.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include "histogram.h"
+
+#define BENCH_SCHEMA_VERSION	1
+
+enum bench_format {
+	BENCH_FMT_TEXT,
+	BENCH_FMT_JSON,
+	BENCH_FMT_CSV,
+};
+
+struct bench_result {
+	const char *suite;		/* e.g. "vmexit", "micro-bench" */
+	const char *name;		/* test name within the suite */
+	int cpu;			/* cpu index, -1 for all cpus */
+	u64 iterations;
+	u64 ticks;			/* total clock ticks */
+	u64 freq;			/* clock ticks per second, 0 if unknown */
+	const struct histogram *hist;	/* per-iteration ticks, or NULL */
+};
+
+/*
+ * Consumes "--json" and "--csv". Returns true if @arg selected an
+ * output format.
+ */
+bool bench_parse_arg(const char *arg);
+
+enum bench_format bench_get_format(void);
+
+/* Prints @r in the selected format; does nothing for BENCH_FMT_TEXT. */
+void bench_emit(const struct bench_result *r);
+
+/* Converts @ticks of a @freq Hz clock into nanoseconds. */
+u64 bench_ticks_to_ns(u64 ticks, u64 freq);
+
+/*
+ * Returns the rate per second of @count events that took @ticks of a
+ * @freq Hz clock, without overflowing on large products.
+ */
+u64 bench_rate(u64 count, u64 ticks, u64 freq);
+
+/*
+ * Emits the samples of @hist, in ticks of a @freq Hz clock, as the
+ * result @name of @suite for @cpu.
+ */
+void bench_emit_hist(const char *suite, const char *name, int cpu,
+		     const struct histogram *hist, u64 freq);
+
+/*
+ * Benchmarks that run on several CPUs.  The architecture provides the
+ * CPU numbering, the clock and a way to start a function on another CPU
+ * with bench_smp_init() at boot: cpu_id returns the index of the calling
+ * CPU, 0 .. nr_cpus - 1, hz the clock's frequency, 0 if unknown, and
+ * on_cpu_async runs func(data) on cpu without waiting for it.
+ */
+void bench_smp_init(int (*cpu_id)(void), u64 (*clock)(void), u64 (*hz)(void),
+		    void (*on_cpu_async)(int cpu, void (*func)(void *data),
+					 void *data));
+
+int bench_cpu_id(void);
+u64 bench_clock(void);
+u64 bench_clock_hz(void);
+
+/*
+ * Calls @func(@data) on CPUs 0 .. @ncpus - 1, the caller being CPU 0, and
+ * returns once all of them have returned.
+ */
+void bench_run_on_first_cpus(int ncpus, void (*func)(void *data), void *data);
+
+/*
+ * For the @func of bench_run_on_first_cpus(): waits until all the CPUs
+ * have got here, the last of them starting the clock, and returns the
+ * time @duration ticks after that, the same on all CPUs.
+ */
+u64 bench_wait_start(u64 duration);
+
+#endif /* _BENCH_H_ */
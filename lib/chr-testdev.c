@@ -25,8 +25,7 @@ static void __testdev_send(char *buf, unsigned int len)
 	if (ret < 0)
 		return;
 
-	while (!virtqueue_get_buf(out_vq, &len))
-		;
+	virtqueue_wait_buf(out_vq, &len);
 }
 
 void chr_testdev_exit(int code)
@@ -0,0 +1,78 @@
+/*
+ * Log-linear histogram for latency samples.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include "histogram.h"
+
+void hist_init(struct histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = ~0ULL;
+}
+
+void hist_merge(struct histogram *dst, const struct histogram *src)
+{
+	int i;
+
+	if (!src->count)
+		return;
+
+	for (i = 0; i < HIST_NR_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+static u64 hist_bucket_max(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < HIST_SUB_BUCKETS)
+		return idx;
+
+	shift = (idx >> HIST_SUB_BITS) - 1;
+	return (((u64)(HIST_SUB_BUCKETS | (idx & (HIST_SUB_BUCKETS - 1))) + 1)
+		<< shift) - 1;
+}
+
+u64 hist_permille(const struct histogram *h, unsigned int permille)
+{
+	u64 rank, seen = 0, val;
+	int i;
+
+	if (!h->count)
+		return 0;
+
+	/* Rank of the sample we are looking for, rounded up, 1-based. */
+	rank = (h->count * permille + 999) / 1000;
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < HIST_NR_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+
+	val = hist_bucket_max(i);
+	if (val < h->min)
+		val = h->min;
+	if (val > h->max)
+		val = h->max;
+	return val;
+}
+
+void hist_print(const char *name, const struct histogram *h)
+{
+	printf("%s min %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64
+	       " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 "\n",
+	       name, h->count ? h->min : 0,
+	       hist_permille(h, 500), hist_permille(h, 900),
+	       hist_permille(h, 990), hist_permille(h, 999), h->max);
+}
@@ -0,0 +1,66 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+/*
+ * Log-linear histogram for latency samples.
+ *
+ * Values below HIST_SUB_BUCKETS are counted exactly; every power of two
+ * above that is split into HIST_SUB_BUCKETS linear sub-buckets, so the
+ * relative error of a reported percentile is bounded by
+ * 1 / HIST_SUB_BUCKETS while the histogram stays a fixed size.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+
+#define HIST_SUB_BITS		4
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+#define HIST_NR_BUCKETS		((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct histogram {
+	u64 count;
+	u64 sum;
+	u64 min;
+	u64 max;
+	u32 buckets[HIST_NR_BUCKETS];
+};
+
+static inline unsigned int hist_bucket(u64 val)
+{
+	unsigned int shift;
+
+	if (val < HIST_SUB_BUCKETS)
+		return val;
+
+	shift = 63 - __builtin_clzll(val) - HIST_SUB_BITS;
+	return ((shift + 1) << HIST_SUB_BITS) |
+	       ((val >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+static inline void hist_add(struct histogram *h, u64 val)
+{
+	h->buckets[hist_bucket(val)]++;
+	h->count++;
+	h->sum += val;
+	if (val < h->min)
+		h->min = val;
+	if (val > h->max)
+		h->max = val;
+}
+
+void hist_init(struct histogram *h);
+void hist_merge(struct histogram *dst, const struct histogram *src);
+
+/*
+ * Returns the upper bound of the bucket holding the sample at @permille
+ * parts per thousand of the distribution (e.g. 990 for p99, 999 for
+ * p99.9), clamped to the recorded min and max.
+ */
+u64 hist_permille(const struct histogram *h, unsigned int permille);
+
+/*
+ * Prints "@name min <n> p50 <n> p90 <n> p99 <n> p99.9 <n> max <n>" on a
+ * single line.
+ */
+void hist_print(const char *name, const struct histogram *h);
+
+#endif /* _HISTOGRAM_H_ */
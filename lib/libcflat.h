@@ -113,6 +113,13 @@ extern void report_fail(const char *msg_fmt, ...)
 extern void report_passed(void);
 extern int report_summary(void);
 
+/*
+ * Iterate over the arguments of the tests batched into this run, one call
+ * per test, see report.c.  Without a batch, the first call returns all
+ * arguments.  Returns false when there are no more.
+ */
+extern bool report_batch_next(int *argc, const char ***argv);
+
 bool simple_glob(const char *text, const char *pattern);
 
 extern void dump_stack(void);
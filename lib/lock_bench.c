@@ -0,0 +1,207 @@
+/*
+ * Spinlock contention benchmark, see lock_bench.h.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <alloc.h>
+#include <bench.h>
+#include <histogram.h>
+#include <locks.h>
+#include <lock_bench.h>
+
+#define DURATION_MS	200
+#define DURATION	(1ull << 28)	/* clock ticks, if its frequency is unknown */
+
+struct lock_type {
+	const char *name;
+	void (*lock)(bool relax);
+	void (*unlock)(void);
+};
+
+struct mcs_cpu_node {
+	struct mcs_node node;
+} __attribute__((aligned(64)));
+
+static struct tas_spinlock tas_lock;
+static struct ticket_spinlock ticket_lock;
+static struct mcs_spinlock mcs_lock;
+static struct mcs_cpu_node *mcs_nodes;
+
+static void tas_acquire(bool relax)
+{
+	__tas_spin_lock(&tas_lock, relax);
+}
+
+static void tas_release(void)
+{
+	tas_spin_unlock(&tas_lock);
+}
+
+static void ticket_acquire(bool relax)
+{
+	__ticket_spin_lock(&ticket_lock, relax);
+}
+
+static void ticket_release(void)
+{
+	ticket_spin_unlock(&ticket_lock);
+}
+
+static void mcs_acquire(bool relax)
+{
+	__mcs_spin_lock(&mcs_lock, &mcs_nodes[bench_cpu_id()].node, relax);
+}
+
+static void mcs_release(void)
+{
+	mcs_spin_unlock(&mcs_lock, &mcs_nodes[bench_cpu_id()].node);
+}
+
+static struct lock_type lock_types[] = {
+	{ "tas", tas_acquire, tas_release },
+	{ "ticket", ticket_acquire, ticket_release },
+	{ "mcs", mcs_acquire, mcs_release },
+};
+
+struct cpu_stats {
+	struct histogram acquire;	/* ticks from asking for the lock to getting it */
+	u64 hold;			/* ticks the lock was held in total */
+};
+
+static const char *lock_suite;
+static int nr_cpus;
+static u64 hz, duration;
+static struct cpu_stats *stats;
+
+static struct lock_type *cur_type;
+static bool cur_relax;
+static u64 shared_count;
+
+static void lock_loop(void *data)
+{
+	struct cpu_stats *s = &stats[bench_cpu_id()];
+	struct lock_type *type = cur_type;
+	bool relax = cur_relax;
+	u64 t0, t1, t2, deadline;
+
+	hist_init(&s->acquire);
+	s->hold = 0;
+
+	deadline = bench_wait_start(duration);
+
+	while ((t0 = bench_clock()) < deadline) {
+		type->lock(relax);
+		t1 = bench_clock();
+		shared_count++;
+		t2 = bench_clock();
+		type->unlock();
+		hist_add(&s->acquire, t1 - t0);
+		s->hold += t2 - t1;
+	}
+}
+
+static u64 fairness(u64 min, u64 max)
+{
+	return max ? min * 1000 / max : 0;
+}
+
+static void run_lock(struct lock_type *type, bool relax, int ncpus)
+{
+	u64 min_count = -1ull, max_count = 0, min_hold = -1ull, max_hold = 0;
+	struct histogram total;
+	char name[32];
+	int i;
+
+	snprintf(name, sizeof(name), "%s%s@%d", type->name,
+		 relax ? "" : "-nopause", ncpus);
+
+	cur_type = type;
+	cur_relax = relax;
+	shared_count = 0;
+	bench_run_on_first_cpus(ncpus, lock_loop, NULL);
+
+	hist_init(&total);
+	for (i = 0; i < ncpus; ++i) {
+		struct cpu_stats *s = &stats[i];
+
+		hist_merge(&total, &s->acquire);
+		min_count = MIN(min_count, s->acquire.count);
+		max_count = MAX(max_count, s->acquire.count);
+		min_hold = MIN(min_hold, s->hold);
+		max_hold = MAX(max_hold, s->hold);
+	}
+
+	report(shared_count == total.count, "%s", name);
+
+	printf("  %s", name);
+	if (hz)
+		printf(" acquisitions/s %" PRIu64, total.count * hz / duration);
+	printf(" fairness %" PRIu64 "/1000 hold-fairness %" PRIu64 "/1000\n",
+	       fairness(min_count, max_count), fairness(min_hold, max_hold));
+	hist_print(name, &total);
+
+	if (bench_get_format() == BENCH_FMT_TEXT)
+		return;
+
+	bench_emit_hist(lock_suite, name, -1, &total, hz);
+	for (i = 0; ncpus > 1 && i < ncpus; ++i)
+		bench_emit_hist(lock_suite, name, i, &stats[i].acquire, hz);
+}
+
+static bool lock_wanted(struct lock_type *type, char **wanted, int nwanted)
+{
+	int i;
+
+	if (!nwanted)
+		return true;
+
+	for (i = 0; i < nwanted; ++i)
+		if (strcmp(wanted[i], type->name) == 0)
+			return true;
+
+	return false;
+}
+
+int lock_bench_main(const char *suite, int ncpus, int argc, char **argv)
+{
+	bool pause_mode = true, nopause_mode = true;
+	int i, n, nwanted = 0;
+
+	lock_suite = suite;
+	nr_cpus = ncpus;
+
+	/* Strip options from the argument list, the rest are lock names. */
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--pause") == 0)
+			nopause_mode = false;
+		else if (strcmp(argv[i], "--nopause") == 0)
+			pause_mode = false;
+		else if (!bench_parse_arg(argv[i]))
+			argv[++nwanted] = argv[i];
+	}
+
+	stats = calloc(nr_cpus, sizeof(*stats));
+	mcs_nodes = memalign(64, nr_cpus * sizeof(*mcs_nodes));
+	assert(stats && mcs_nodes);
+
+	hz = bench_clock_hz();
+	duration = hz ? hz * DURATION_MS / 1000 : DURATION;
+	printf("%d cpus, clock frequency %" PRIu64 " Hz\n", nr_cpus, hz);
+
+	for (i = 0; i < ARRAY_SIZE(lock_types); ++i) {
+		if (!lock_wanted(&lock_types[i], argv + 1, nwanted))
+			continue;
+
+		for (n = 1; ; n = MIN(n * 2, nr_cpus)) {
+			if (pause_mode)
+				run_lock(&lock_types[i], true, n);
+			if (nopause_mode)
+				run_lock(&lock_types[i], false, n);
+			if (n == nr_cpus)
+				break;
+		}
+	}
+
+	return report_summary();
+}
@@ -0,0 +1,30 @@
+#ifndef _LOCK_BENCH_H_
+#define _LOCK_BENCH_H_
+/*
+ * Spinlock contention benchmark, the body of x86/lock_bench.c and
+ * arm/lock-bench.c.
+ *
+ * The first 1, 2, 4, ... and finally all CPUs hammer a single lock for a
+ * fixed time, each recording how long every acquisition took, how often
+ * it got the lock and for how long it held it.  This is done for the
+ * tas, ticket and mcs locks from locks.h, both spinning with the
+ * architecture's cpu_relax() and, with the "-nopause" suffix, without it.
+ * The lock protects a shared counter, which also serves as a correctness
+ * check.
+ *
+ * Fairness is the share of the least lucky CPU relative to the luckiest,
+ * in 1/1000, both for the number of acquisitions and for the time the
+ * lock was held.  Times are in ticks of bench_clock().
+ *
+ * usage: [--json|--csv] [--pause|--nopause] [tas|ticket|mcs...]
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+
+/*
+ * Runs the benchmark on @ncpus CPUs, reporting its results under @suite,
+ * and returns report_summary().
+ */
+int lock_bench_main(const char *suite, int ncpus, int argc, char **argv);
+
+#endif /* _LOCK_BENCH_H_ */
@@ -0,0 +1,131 @@
+#ifndef _LOCKS_H_
+#define _LOCKS_H_
+/*
+ * Spinlock algorithms built only on the compiler's atomic builtins, so
+ * that they can be used on every architecture (on arm only once the MMU
+ * is enabled, as exclusive accesses need cacheable memory).
+ *
+ *  - struct ticket_spinlock: CPUs are granted the lock in the order in
+ *    which they asked for it, so no CPU can be starved by others that
+ *    keep winning the race for the lock word.
+ *  - struct tas_spinlock: test-and-test-and-set.  Cheapest when
+ *    uncontended, but unfair.
+ *  - struct mcs_spinlock: a queued (MCS) lock where every waiter spins
+ *    on its own struct mcs_node, which must stay valid until the lock is
+ *    released.  Fair, and a release only touches the next waiter's
+ *    cache line.
+ *
+ * All of them are unlocked when zero-initialized.  Waiters spin with
+ * cpu_relax(); the __*_spin_lock() variants can be told not to, which is
+ * only useful to measure what cpu_relax() costs or saves, e.g. pause-loop
+ * exiting on x86.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include <libcflat.h>
+#include <asm/barrier.h>
+
+static inline void __lock_spin(bool relax)
+{
+	if (relax)
+		cpu_relax();
+	else
+		barrier();
+}
+
+struct ticket_spinlock {
+	unsigned int next;
+	unsigned int owner;
+};
+
+static inline void __ticket_spin_lock(struct ticket_spinlock *lock, bool relax)
+{
+	unsigned int ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+
+	while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
+		__lock_spin(relax);
+}
+
+static inline void ticket_spin_lock(struct ticket_spinlock *lock)
+{
+	__ticket_spin_lock(lock, true);
+}
+
+static inline void ticket_spin_unlock(struct ticket_spinlock *lock)
+{
+	__atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+struct tas_spinlock {
+	unsigned int v;
+};
+
+static inline void __tas_spin_lock(struct tas_spinlock *lock, bool relax)
+{
+	while (__sync_lock_test_and_set(&lock->v, 1)) {
+		while (__atomic_load_n(&lock->v, __ATOMIC_RELAXED))
+			__lock_spin(relax);
+	}
+}
+
+static inline void tas_spin_lock(struct tas_spinlock *lock)
+{
+	__tas_spin_lock(lock, true);
+}
+
+static inline void tas_spin_unlock(struct tas_spinlock *lock)
+{
+	__sync_lock_release(&lock->v);
+}
+
+struct mcs_node {
+	struct mcs_node *next;
+	unsigned int locked;
+};
+
+struct mcs_spinlock {
+	struct mcs_node *tail;
+};
+
+static inline void __mcs_spin_lock(struct mcs_spinlock *lock,
+				   struct mcs_node *node, bool relax)
+{
+	struct mcs_node *prev;
+
+	node->next = NULL;
+	node->locked = 0;
+
+	prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+	if (!prev)
+		return;
+
+	__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+	while (!__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+		__lock_spin(relax);
+}
+
+static inline void mcs_spin_lock(struct mcs_spinlock *lock, struct mcs_node *node)
+{
+	__mcs_spin_lock(lock, node, true);
+}
+
+static inline void mcs_spin_unlock(struct mcs_spinlock *lock, struct mcs_node *node)
+{
+	struct mcs_node *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+
+	if (!next) {
+		struct mcs_node *expected = node;
+
+		if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, false,
+						__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return;
+
+		/* A new waiter swapped itself in but has not linked up yet. */
+		while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+			cpu_relax();
+	}
+
+	__atomic_store_n(&next->locked, 1, __ATOMIC_RELEASE);
+}
+
+#endif /* _LOCKS_H_ */
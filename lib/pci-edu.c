@@ -39,8 +39,8 @@ bool edu_init(struct pci_edu_dev *dev)
 	return true;
 }
 
-void edu_dma(struct pci_edu_dev *dev, iova_t iova,
-	     size_t size, unsigned int dev_offset, bool from_device)
+void edu_dma_start(struct pci_edu_dev *dev, iova_t iova, size_t size,
+		   unsigned int dev_offset, bool from_device, bool irq)
 {
 	uint64_t from, to;
 	uint32_t cmd = EDU_CMD_DMA_START;
@@ -48,10 +48,6 @@ void edu_dma(struct pci_edu_dev *dev, iova_t iova,
 	assert(size <= EDU_DMA_SIZE_MAX);
 	assert(dev_offset < EDU_DMA_SIZE_MAX);
 
-	printf("edu device DMA start %s addr %#" PRIx64 " size %lu off %#x\n",
-	       from_device ? "FROM" : "TO",
-	       iova, (ulong)size, dev_offset);
-
 	if (from_device) {
 		from = dev_offset + EDU_DMA_START;
 		to = iova;
@@ -62,12 +58,25 @@ void edu_dma(struct pci_edu_dev *dev, iova_t iova,
 		cmd |= EDU_CMD_DMA_TO;
 	}
 
+	if (irq)
+		cmd |= EDU_CMD_DMA_IRQ;
+
 	edu_reg_writeq(dev, EDU_REG_DMA_SRC, from);
 	edu_reg_writeq(dev, EDU_REG_DMA_DST, to);
 	edu_reg_writeq(dev, EDU_REG_DMA_COUNT, size);
 	edu_reg_writel(dev, EDU_REG_DMA_CMD, cmd);
+}
+
+void edu_dma(struct pci_edu_dev *dev, iova_t iova,
+	     size_t size, unsigned int dev_offset, bool from_device)
+{
+	printf("edu device DMA start %s addr %#" PRIx64 " size %lu off %#x\n",
+	       from_device ? "FROM" : "TO",
+	       iova, (ulong)size, dev_offset);
+
+	edu_dma_start(dev, iova, size, dev_offset, from_device, false);
 
 	/* Wait until DMA finished */
-	while (edu_reg_readl(dev, EDU_REG_DMA_CMD) & EDU_CMD_DMA_START)
+	while (edu_dma_busy(dev))
 		cpu_relax();
 }
@@ -43,10 +43,14 @@
 #define EDU_CMD_DMA_START           0x01
 #define EDU_CMD_DMA_FROM            0x02
 #define EDU_CMD_DMA_TO              0x00
+#define EDU_CMD_DMA_IRQ             0x04
 
 #define EDU_STATUS_FACTORIAL        0x1
 #define EDU_STATUS_INT_ENABLE       0x80
 
+/* Interrupt status bit raised on DMA completion if EDU_CMD_DMA_IRQ */
+#define EDU_INTR_DMA_DONE           0x100
+
 #define EDU_DMA_START               0x40000
 #define EDU_DMA_SIZE_MAX            4096
 
@@ -79,8 +83,19 @@ static inline void edu_reg_writel(struct pci_edu_dev *dev, int reg,
 	__raw_writel(val, edu_reg(dev, reg));
 }
 
+static inline bool edu_dma_busy(struct pci_edu_dev *dev)
+{
+	return edu_reg_readl(dev, EDU_REG_DMA_CMD) & EDU_CMD_DMA_START;
+}
+
 bool edu_init(struct pci_edu_dev *dev);
 void edu_dma(struct pci_edu_dev *dev, iova_t iova,
 	     size_t size, unsigned int dev_offset, bool from_device);
+/*
+ * Starts a DMA without waiting for it, see edu_dma_busy().  If @irq, the
+ * device raises EDU_INTR_DMA_DONE when it is done.
+ */
+void edu_dma_start(struct pci_edu_dev *dev, iova_t iova, size_t size,
+		   unsigned int dev_offset, bool from_device, bool irq);
 
 #endif
@@ -216,7 +216,10 @@ bool pci_probe(void)
 	u32 cmd;
 	int i;
 
-	assert(!pci_host_bridge);
+	/* Resources are only assigned once, e.g. before virtio_bind() */
+	if (pci_host_bridge)
+		return true;
+
 	pci_host_bridge = pci_dt_probe();
 	if (!pci_host_bridge)
 		return false;
@@ -6,6 +6,7 @@
 #include <linux/pci_regs.h>
 #include "pci.h"
 #include "asm/pci.h"
+#include "asm/io.h"
 
 void pci_cap_walk(struct pci_dev *dev, pci_cap_handler_t handler)
 {
@@ -72,6 +73,84 @@ bool pci_setup_msi(struct pci_dev *dev, uint64_t msi_addr, uint32_t msi_data)
 	return true;
 }
 
+int pci_msix_table_size(struct pci_dev *dev)
+{
+	uint16_t msix_control;
+
+	if (!dev->msix_offset)
+		return 0;
+
+	msix_control = pci_config_readw(dev->bdf, dev->msix_offset + PCI_MSIX_FLAGS);
+	return (msix_control & PCI_MSIX_FLAGS_QSIZE) + 1;
+}
+
+void pci_msix_set_enable(struct pci_dev *dev, bool enabled)
+{
+	uint16_t msix_control;
+	uint16_t offset;
+
+	offset = dev->msix_offset;
+	msix_control = pci_config_readw(dev->bdf, offset + PCI_MSIX_FLAGS);
+
+	msix_control &= ~PCI_MSIX_FLAGS_MASKALL;
+	if (enabled)
+		msix_control |= PCI_MSIX_FLAGS_ENABLE;
+	else
+		msix_control &= ~PCI_MSIX_FLAGS_ENABLE;
+
+	pci_config_writew(dev->bdf, offset + PCI_MSIX_FLAGS, msix_control);
+}
+
+static void *pci_msix_entry(struct pci_dev *dev, unsigned int entry)
+{
+	uint32_t table;
+	int bar;
+
+	assert(entry < pci_msix_table_size(dev));
+
+	if (!dev->msix_table) {
+		table = pci_config_readl(dev->bdf, dev->msix_offset + PCI_MSIX_TABLE);
+		bar = table & PCI_MSIX_TABLE_BIR;
+		assert(pci_bar_is_valid(dev, bar) && pci_bar_is_memory(dev, bar));
+		dev->msix_table = ioremap(pci_bar_get_addr(dev, bar) +
+					  (table & PCI_MSIX_TABLE_OFFSET),
+					  pci_msix_table_size(dev) * PCI_MSIX_ENTRY_SIZE);
+	}
+
+	return dev->msix_table + entry * PCI_MSIX_ENTRY_SIZE;
+}
+
+void pci_msix_mask(struct pci_dev *dev, unsigned int entry, bool masked)
+{
+	void *e = pci_msix_entry(dev, entry);
+
+	writel(masked ? PCI_MSIX_ENTRY_CTRL_MASKBIT : 0,
+	       e + PCI_MSIX_ENTRY_VECTOR_CTRL);
+}
+
+bool pci_setup_msix(struct pci_dev *dev, unsigned int entry,
+		    uint64_t msi_addr, uint32_t msi_data)
+{
+	void *e;
+
+	assert(dev);
+
+	if (!dev->msix_offset) {
+		printf("MSI-X: dev %#x does not support MSI-X.\n", dev->bdf);
+		return false;
+	}
+
+	e = pci_msix_entry(dev, entry);
+	writel(msi_addr & 0xffffffff, e + PCI_MSIX_ENTRY_LOWER_ADDR);
+	writel((uint32_t)(msi_addr >> 32), e + PCI_MSIX_ENTRY_UPPER_ADDR);
+	writel(msi_data, e + PCI_MSIX_ENTRY_DATA);
+	pci_msix_mask(dev, entry, false);
+
+	pci_msix_set_enable(dev, true);
+
+	return true;
+}
+
 void pci_cmd_set_clr(struct pci_dev *dev, uint16_t set, uint16_t clr)
 {
 	uint16_t val = pci_config_readw(dev->bdf, PCI_COMMAND);
@@ -294,6 +373,11 @@ static void pci_cap_print(struct pci_dev *dev, int cap_offset, int cap_id)
 		printf("\tMSI,%s-bit capability ", control & PCI_MSI_FLAGS_64BIT ? "64" : "32");
 		break;
 	}
+	case PCI_CAP_ID_MSIX: {
+		uint16_t control = pci_config_readw(dev->bdf, cap_offset + PCI_MSIX_FLAGS);
+		printf("\tMSI-X,%d entries capability ", (control & PCI_MSIX_FLAGS_QSIZE) + 1);
+		break;
+	}
 	default:
 		printf("\tcapability %#04x ", cap_id);
 		break;
@@ -375,6 +459,9 @@ static void pci_cap_setup(struct pci_dev *dev, int cap_offset, int cap_id)
 	case PCI_CAP_ID_MSI:
 		dev->msi_offset = cap_offset;
 		break;
+	case PCI_CAP_ID_MSIX:
+		dev->msix_offset = cap_offset;
+		break;
 	}
 }
 
@@ -27,6 +27,8 @@ enum {
 struct pci_dev {
 	uint16_t bdf;
 	uint16_t msi_offset;
+	uint16_t msix_offset;
+	void *msix_table;
 	phys_addr_t resource[PCI_BAR_NUM];
 };
 
@@ -71,6 +73,16 @@ extern void pci_dev_print(struct pci_dev *dev);
 extern uint8_t pci_intx_line(struct pci_dev *dev);
 void pci_msi_set_enable(struct pci_dev *dev, bool enabled);
 
+/*
+ * MSI-X, found by pci_enable_defaults().  pci_setup_msix() programs and
+ * unmasks table entry @entry and enables MSI-X for the function.
+ */
+extern int pci_msix_table_size(struct pci_dev *dev);
+extern bool pci_setup_msix(struct pci_dev *dev, unsigned int entry,
+			   uint64_t msi_addr, uint32_t msi_data);
+extern void pci_msix_mask(struct pci_dev *dev, unsigned int entry, bool masked);
+extern void pci_msix_set_enable(struct pci_dev *dev, bool enabled);
+
 extern int pci_testdev(void);
 
 /*
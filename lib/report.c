@@ -11,6 +11,7 @@
  */
 
 #include "libcflat.h"
+#include "trace.h"
 #include "asm/spinlock.h"
 
 static unsigned int tests, failures, xfailures, skipped;
@@ -80,6 +81,32 @@ void report_prefix_pop(void)
 	spin_unlock(&lock);
 }
 
+/*
+ * With REPORT_TIMING set in the environment, each report is followed by a
+ * "TIMING: <us>" line with the microseconds since the previous report, or
+ * for the first one since the start of the clock (normally the boot of the
+ * VM), so that the slow checks of a test can be found, e.g. in the JUnit
+ * XML written by run_tests.sh --junit.  It needs the trace clock, see
+ * trace_init().
+ */
+static void report_timing(void)
+{
+	static int enabled = -1;
+	static u64 last;
+	u64 now;
+
+	if (enabled < 0)
+		enabled = getenv("REPORT_TIMING") != NULL;
+	if (!enabled)
+		return;
+
+	now = trace_clock_ns();
+	if (!now)
+		return;
+	printf("TIMING: %" PRIu64 "\n", (now - last) / 1000);
+	last = now;
+}
+
 static void va_report(const char *msg_fmt,
 		bool pass, bool xfail, bool skip, va_list va)
 {
@@ -94,6 +121,7 @@ static void va_report(const char *msg_fmt,
 	puts(prefixes);
 	vprintf(msg_fmt, va);
 	puts("\n");
+	report_timing();
 	if (skip)
 		skipped++;
 	else if (xfail && !pass)
@@ -160,11 +188,9 @@ void report_info(const char *msg_fmt, ...)
 	spin_unlock(&lock);
 }
 
-int report_summary(void)
+static void print_summary(unsigned int tests, unsigned int failures,
+			  unsigned int xfailures, unsigned int skipped)
 {
-	int ret;
-	spin_lock(&lock);
-
 	printf("SUMMARY: %d tests", tests);
 	if (failures)
 		printf(", %d unexpected failures", failures);
@@ -173,6 +199,70 @@ int report_summary(void)
 	if (skipped)
 		printf(", %d skipped", skipped);
 	printf("\n");
+}
+
+/*
+ * run_tests.sh --batch runs several tests of unittests.cfg in one boot,
+ * passing their arguments separated by BATCH_SEPARATOR.  Each segment is
+ * framed by "BATCH-BEGIN: <n>" and "BATCH-END: <n> SUMMARY: ..." lines,
+ * n counting from 1, with the summary of the reports made in between.
+ */
+#define BATCH_SEPARATOR "---"
+
+static int batch_index;
+static unsigned int batch_tests, batch_failures, batch_xfailures, batch_skipped;
+
+bool report_batch_next(int *argc, const char ***argv)
+{
+	static const char **rest;
+	static int nr_rest;
+	static bool batch;
+	int i, n;
+
+	if (!batch_index) {
+		rest = *argv;
+		nr_rest = *argc;
+		for (i = 0; i < nr_rest; i++)
+			batch |= !strcmp(rest[i], BATCH_SEPARATOR);
+	} else if (batch) {
+		spin_lock(&lock);
+		printf("BATCH-END: %d ", batch_index);
+		print_summary(tests - batch_tests, failures - batch_failures,
+			      xfailures - batch_xfailures, skipped - batch_skipped);
+		spin_unlock(&lock);
+	}
+
+	if (nr_rest < 0)
+		return false;
+
+	for (n = 0; n < nr_rest && strcmp(rest[n], BATCH_SEPARATOR); n++)
+		;
+	*argv = rest;
+	*argc = n;
+	rest += n + 1;
+	nr_rest = n < nr_rest ? nr_rest - n - 1 : -1;
+	batch_index++;
+
+	if (batch) {
+		spin_lock(&lock);
+		batch_tests = tests;
+		batch_failures = failures;
+		batch_xfailures = xfailures;
+		batch_skipped = skipped;
+		printf("BATCH-BEGIN: %d\n", batch_index);
+		spin_unlock(&lock);
+	}
+	return true;
+}
+
+int report_summary(void)
+{
+	int ret;
+
+	trace_dump();
+	spin_lock(&lock);
+
+	print_summary(tests, failures, xfailures, skipped);
 
 	if (tests == skipped) {
 		spin_unlock(&lock);
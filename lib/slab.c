@@ -0,0 +1,288 @@
+/*
+ * Object caches for small fixed-size objects, layered on the page
+ * allocator.
+ *
+ * Every slab is a naturally aligned block of 1 << order pages that starts
+ * with a struct slab, followed by the objects.  Free objects are chained
+ * through their first word, so that freeing only needs to round the
+ * object's address down to the slab size to find its slab.
+ *
+ * Slabs with free objects are kept on the cache's partial list, full ones
+ * on no list at all.  A slab that becomes empty is kept as the cache's
+ * spare, unless the cache already has one, so that a single object being
+ * allocated and freed in a loop does not bounce a slab to and from the
+ * page allocator.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "alloc_page.h"
+#include "bitops.h"
+#include "list.h"
+#include "slab.h"
+#include <asm/page.h>
+#include <asm/spinlock.h>
+
+/* Largest slab, and the number of objects a slab should at least hold. */
+#define SLAB_MAX_ORDER	3
+#define SLAB_MIN_OBJS	8
+
+struct slab {
+	struct linked_list list;	/* must be first, see list_to_slab() */
+	struct kmem_cache *cache;
+	void *freelist;
+	unsigned int inuse;
+};
+
+struct kmem_cache {
+	struct linked_list list;	/* in the list of all caches */
+	const char *name;
+	size_t size;			/* object size, including padding */
+	size_t offset;			/* of the first object in a slab */
+	unsigned int order;
+	unsigned int flags;
+	unsigned int objs_per_slab;
+	struct spinlock lock;
+	struct linked_list partial;
+	struct slab *spare;
+	struct kmem_cache_stats stats;
+};
+
+static struct spinlock caches_lock;
+static struct linked_list caches = { &caches, &caches };
+static struct kmem_cache cache_cache;
+
+static inline struct slab *list_to_slab(struct linked_list *l)
+{
+	return (struct slab *)l;
+}
+
+static size_t slab_size(struct kmem_cache *cache)
+{
+	return PAGE_SIZE << cache->order;
+}
+
+static bool init_cache(struct kmem_cache *cache, const char *name, size_t size,
+		       size_t align, unsigned int flags)
+{
+	unsigned int order;
+	size_t offset, objs;
+
+	if (!align)
+		align = sizeof(void *);
+	assert(is_power_of_2(align));
+
+	/* Free objects hold the freelist link. */
+	size = ALIGN(MAX(size, sizeof(void *)), MAX(align, sizeof(void *)));
+	offset = ALIGN(sizeof(struct slab), align);
+
+	for (order = 0; ; order++) {
+		if (offset + size <= PAGE_SIZE << order)
+			objs = ((PAGE_SIZE << order) - offset) / size;
+		else
+			objs = 0;
+		if (objs >= SLAB_MIN_OBJS || order == SLAB_MAX_ORDER)
+			break;
+	}
+	if (!objs)
+		return false;
+
+	memset(cache, 0, sizeof(*cache));
+	cache->name = name;
+	cache->size = size;
+	cache->offset = offset;
+	cache->order = order;
+	cache->flags = flags | FLAG_DONTZERO;
+	cache->objs_per_slab = objs;
+	cache->partial.prev = cache->partial.next = &cache->partial;
+	cache->stats.objs_per_slab = objs;
+	cache->stats.slab_size = PAGE_SIZE << order;
+	cache->stats.obj_size = size;
+	return true;
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     size_t align, unsigned int flags)
+{
+	struct kmem_cache *cache;
+
+	/* The caches themselves come from the statically allocated cache_cache. */
+	spin_lock(&caches_lock);
+	if (!cache_cache.size) {
+		assert(init_cache(&cache_cache, "kmem_cache",
+				  sizeof(struct kmem_cache), 0, 0));
+		list_add_tail(&caches, &cache_cache.list);
+	}
+	spin_unlock(&caches_lock);
+
+	cache = kmem_cache_alloc(&cache_cache);
+	if (!cache)
+		return NULL;
+
+	if (!init_cache(cache, name, size, align, flags)) {
+		kmem_cache_free(&cache_cache, cache);
+		return NULL;
+	}
+
+	spin_lock(&caches_lock);
+	list_add_tail(&caches, &cache->list);
+	spin_unlock(&caches_lock);
+	return cache;
+}
+
+static struct slab *new_slab(struct kmem_cache *cache)
+{
+	struct slab *slab;
+	void **obj;
+	unsigned int i;
+
+	slab = alloc_pages_flags(cache->order, cache->flags);
+	if (!slab)
+		return NULL;
+
+	slab->cache = cache;
+	slab->inuse = 0;
+	slab->freelist = (void *)slab + cache->offset;
+	for (i = 0, obj = slab->freelist; i < cache->objs_per_slab - 1; i++) {
+		*obj = (void *)obj + cache->size;
+		obj = *obj;
+	}
+	*obj = NULL;
+
+	cache->stats.slabs++;
+	return slab;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+	struct slab *slab;
+	void **obj;
+
+	spin_lock(&cache->lock);
+	if (!is_list_empty(&cache->partial)) {
+		slab = list_to_slab(cache->partial.next);
+	} else {
+		slab = cache->spare;
+		cache->spare = NULL;
+		if (!slab)
+			slab = new_slab(cache);
+		if (!slab) {
+			cache->stats.failed++;
+			spin_unlock(&cache->lock);
+			return NULL;
+		}
+		list_add(&cache->partial, &slab->list);
+	}
+
+	obj = slab->freelist;
+	slab->freelist = *obj;
+	if (++slab->inuse == cache->objs_per_slab)
+		list_remove(&slab->list);
+
+	cache->stats.allocs++;
+	if (++cache->stats.active > cache->stats.peak)
+		cache->stats.peak = cache->stats.active;
+	spin_unlock(&cache->lock);
+
+	return obj;
+}
+
+void *kmem_cache_zalloc(struct kmem_cache *cache)
+{
+	void *obj = kmem_cache_alloc(cache);
+
+	if (obj)
+		memset(obj, 0, cache->size);
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+	struct slab *slab;
+	struct slab *old = NULL;
+
+	if (!obj)
+		return;
+
+	slab = (void *)((uintptr_t)obj & ~(slab_size(cache) - 1));
+	assert(slab->cache == cache);
+	assert(obj >= (void *)slab + cache->offset);
+	assert(((obj - (void *)slab) - cache->offset) % cache->size == 0);
+
+	spin_lock(&cache->lock);
+	assert(slab->inuse);
+	if (slab->inuse-- == cache->objs_per_slab)
+		list_add(&cache->partial, &slab->list);
+	*(void **)obj = slab->freelist;
+	slab->freelist = obj;
+
+	if (!slab->inuse) {
+		list_remove(&slab->list);
+		old = cache->spare;
+		cache->spare = slab;
+		if (old)
+			cache->stats.slabs--;
+	}
+
+	cache->stats.frees++;
+	cache->stats.active--;
+	spin_unlock(&cache->lock);
+
+	if (old)
+		free_pages(old);
+}
+
+void kmem_cache_destroy(struct kmem_cache *cache)
+{
+	if (!cache)
+		return;
+
+	assert(cache != &cache_cache);
+	assert(!cache->stats.active);
+	assert(is_list_empty(&cache->partial));
+
+	spin_lock(&caches_lock);
+	list_remove(&cache->list);
+	spin_unlock(&caches_lock);
+
+	if (cache->spare)
+		free_pages(cache->spare);
+	kmem_cache_free(&cache_cache, cache);
+}
+
+void kmem_cache_get_stats(struct kmem_cache *cache, struct kmem_cache_stats *stats)
+{
+	spin_lock(&cache->lock);
+	*stats = cache->stats;
+	spin_unlock(&cache->lock);
+}
+
+static void print_stats(struct kmem_cache *cache)
+{
+	struct kmem_cache_stats s;
+
+	kmem_cache_get_stats(cache, &s);
+	printf("%-16s %6lu %4lu %6lu %6lu %6lu %8lu %8lu %6lu %4lu\n",
+	       cache->name, s.obj_size, s.objs_per_slab, s.active, s.peak,
+	       s.slabs, s.allocs, s.frees, s.slabs * (s.slab_size / PAGE_SIZE),
+	       s.failed);
+}
+
+void kmem_cache_print_stats(struct kmem_cache *cache)
+{
+	struct linked_list *l;
+
+	printf("%-16s %6s %4s %6s %6s %6s %8s %8s %6s %4s\n", "cache", "size",
+	       "objs", "active", "peak", "slabs", "allocs", "frees", "pages",
+	       "fail");
+
+	if (cache) {
+		print_stats(cache);
+		return;
+	}
+
+	spin_lock(&caches_lock);
+	for (l = caches.next; l != &caches; l = l->next)
+		print_stats((struct kmem_cache *)l);
+	spin_unlock(&caches_lock);
+}
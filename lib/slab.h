@@ -0,0 +1,62 @@
+/*
+ * Object caches for small fixed-size objects, layered on the page
+ * allocator.
+ *
+ * A cache carves naturally aligned blocks of pages (slabs) into objects of
+ * one size, so that e.g. a 64 byte descriptor costs 64 bytes and not the
+ * page (or two, with vmalloc) that malloc would spend on it.  Each cache
+ * keeps its own statistics, see kmem_cache_print_stats().
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <libcflat.h>
+
+struct kmem_cache;
+
+struct kmem_cache_stats {
+	unsigned long allocs;		/* successful allocations */
+	unsigned long frees;
+	unsigned long failed;		/* allocations that found no memory */
+	unsigned long active;		/* objects currently allocated */
+	unsigned long peak;		/* maximum of active */
+	unsigned long slabs;		/* slabs currently held */
+	unsigned long objs_per_slab;
+	unsigned long slab_size;	/* in bytes */
+	unsigned long obj_size;		/* in bytes, including alignment padding */
+};
+
+/*
+ * Create a cache for objects of the given size.
+ * align must be a power of 2, or 0 for the alignment of a pointer.
+ * flags are page allocator flags (see alloc_page.h) used for the slabs,
+ * e.g. to place the objects in a specific memory area.
+ * Returns NULL if the size cannot be served by a slab.
+ */
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     size_t align, unsigned int flags);
+
+/*
+ * Destroy a cache and release its slabs.  All objects must have been
+ * freed.
+ */
+void kmem_cache_destroy(struct kmem_cache *cache);
+
+/* Allocate an object, its contents are undefined.  NULL if out of memory. */
+void *kmem_cache_alloc(struct kmem_cache *cache);
+
+/* Allocate a zeroed object.  NULL if out of memory. */
+void *kmem_cache_zalloc(struct kmem_cache *cache);
+
+/* Free an object allocated from the given cache.  obj may be NULL. */
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+/* Return a snapshot of the statistics of the cache. */
+void kmem_cache_get_stats(struct kmem_cache *cache, struct kmem_cache_stats *stats);
+
+/* Print the statistics of the cache, or of all caches if cache is NULL. */
+void kmem_cache_print_stats(struct kmem_cache *cache);
+
+#endif
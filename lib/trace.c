@@ -0,0 +1,147 @@
+/*
+ * Per-CPU binary trace rings, see trace.h.
+ *
+ * trace_dump() prints, for each CPU, the oldest to newest entries as
+ *
+ *   TRACE: <cpu> <delta> <event> <arg0> <arg1>
+ *
+ * where delta is the signed number of clock ticks since the CPU's previous
+ * entry (since zero for its first one) in decimal, and everything else is
+ * in hex.  Events are numbered in the order they are first seen, and the
+ * first use of each is preceded by a "TRACE-EVENT: <event> <name>" line.
+ * A TRACE-START line carries the clock frequency, a TRACE-END line the
+ * number of entries lost to wrap-around.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "alloc.h"
+#include "trace.h"
+
+#define TRACE_MAX_EVENTS	256
+
+struct trace_ring *trace_rings;
+unsigned long trace_mask;
+struct trace_clock trace_clock;
+
+static unsigned int trace_nr_cpus;
+static u64 (*trace_hz)(void);
+
+void trace_init(unsigned int nr_cpus, int (*cpu_id)(void), u64 (*clock)(void),
+		u64 (*hz)(void))
+{
+	trace_nr_cpus = nr_cpus;
+	trace_clock.cpu_id = cpu_id;
+	trace_clock.read = clock;
+	trace_hz = hz;
+}
+
+bool trace_enable(unsigned int entries)
+{
+	struct trace_ring *rings;
+	unsigned long size = 1;
+	unsigned int i;
+
+	if (!trace_nr_cpus || trace_rings)
+		return false;
+
+	while (size < entries)
+		size <<= 1;
+
+	rings = memalign(__alignof__(*rings), trace_nr_cpus * sizeof(*rings));
+	if (!rings)
+		return false;
+
+	for (i = 0; i < trace_nr_cpus; i++) {
+		rings[i].head = 0;
+		rings[i].entries = calloc(size, sizeof(struct trace_entry));
+		if (!rings[i].entries) {
+			while (i--)
+				free(rings[i].entries);
+			free(rings);
+			return false;
+		}
+	}
+
+	trace_mask = size - 1;
+	__atomic_store_n(&trace_rings, rings, __ATOMIC_RELEASE);
+	return true;
+}
+
+bool trace_enable_env(void)
+{
+	const char *str = getenv("TRACE");
+
+	if (str && !trace_rings && !trace_enable(atol(str)))
+		printf("trace: cannot allocate %s entries per CPU\n", str);
+
+	return trace_rings;
+}
+
+u64 trace_clock_ns(void)
+{
+	static u64 hz;
+	u64 ticks;
+
+	if (!trace_clock.read)
+		return 0;
+	if (!hz && trace_hz)
+		hz = trace_hz();
+	if (!hz)
+		return 0;
+
+	ticks = trace_clock.read();
+	return ticks / hz * 1000000000ULL + ticks % hz * 1000000000ULL / hz;
+}
+
+static unsigned int event_id(const char **events, unsigned int *nr_events,
+			     const char *event)
+{
+	unsigned int i;
+
+	for (i = 0; i < *nr_events; i++)
+		if (events[i] == event)
+			return i;
+
+	if (*nr_events == TRACE_MAX_EVENTS)
+		return TRACE_MAX_EVENTS;
+
+	events[*nr_events] = event;
+	printf("TRACE-EVENT: %x %s\n", *nr_events, event);
+	return (*nr_events)++;
+}
+
+void trace_dump(void)
+{
+	static const char *events[TRACE_MAX_EVENTS];
+	unsigned int nr_events = 0, cpu;
+	unsigned long first, head, i, lost = 0;
+	struct trace_ring *rings;
+	struct trace_entry *e;
+	u64 prev;
+
+	/* Stop tracing; this also keeps a nested abort() from dumping again. */
+	rings = __atomic_exchange_n(&trace_rings, NULL, __ATOMIC_ACQ_REL);
+	if (!rings)
+		return;
+
+	printf("TRACE-START: cpus %u hz %" PRIu64 " entries %lu\n",
+	       trace_nr_cpus, trace_hz ? trace_hz() : 0, trace_mask + 1);
+
+	for (cpu = 0; cpu < trace_nr_cpus; cpu++) {
+		head = __atomic_load_n(&rings[cpu].head, __ATOMIC_ACQUIRE);
+		first = head > trace_mask + 1 ? head - (trace_mask + 1) : 0;
+		lost += first;
+
+		for (i = first, prev = 0; i < head; i++) {
+			e = &rings[cpu].entries[i & trace_mask];
+			printf("TRACE: %x %" PRId64 " %x %" PRIx64 " %" PRIx64 "\n",
+			       cpu, (s64)(e->ts - prev),
+			       event_id(events, &nr_events, e->event),
+			       e->arg0, e->arg1);
+			prev = e->ts;
+		}
+	}
+
+	printf("TRACE-END: lost %lu\n", lost);
+}
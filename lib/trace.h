@@ -0,0 +1,95 @@
+/*
+ * Per-CPU binary trace rings.
+ *
+ * trace() records an event and two arguments with a timestamp in the
+ * calling CPU's ring.  It takes no locks and causes no exits, so unlike
+ * printf() it hardly changes the timing of what is being traced, e.g. of
+ * interrupt delivery.  Each ring keeps the last 'entries' events.  The
+ * rings are dumped to the console by trace_dump(), which report_summary()
+ * and abort() call, and can be decoded with scripts/trace_decode.py.
+ *
+ * Tracing is off until a test calls trace_enable(), or trace_enable_env()
+ * with TRACE set in the environment.  The architecture provides the clock
+ * and the CPU numbering with trace_init() at boot.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <libcflat.h>
+
+struct trace_entry {
+	u64 ts;
+	const char *event;	/* a string literal, used as the event id */
+	u64 arg0;
+	u64 arg1;
+};
+
+struct trace_ring {
+	struct trace_entry *entries;
+	unsigned long head;	/* number of events ever recorded */
+} __attribute__((aligned(64)));
+
+struct trace_clock {
+	int (*cpu_id)(void);
+	u64 (*read)(void);
+};
+
+extern struct trace_ring *trace_rings;
+extern unsigned long trace_mask;
+extern struct trace_clock trace_clock;
+
+/*
+ * Called by the architecture's setup code.  nr_cpus is the number of
+ * rings, cpu_id must return the index of the calling CPU's ring, smaller
+ * than nr_cpus, and clock returns the timestamps.  hz, which is only
+ * called by trace_dump(), returns the clock's frequency, 0 if unknown; it
+ * may be NULL.
+ */
+void trace_init(unsigned int nr_cpus, int (*cpu_id)(void), u64 (*clock)(void),
+		u64 (*hz)(void));
+
+/*
+ * Start tracing with rings of entries events (rounded up to a power of
+ * 2) per CPU.  Returns false if the rings cannot be allocated.
+ */
+bool trace_enable(unsigned int entries);
+
+/*
+ * Start tracing if TRACE=<entries> is set in the environment, so that
+ * tests can leave their trace points in place.  Returns true if tracing
+ * is on.
+ */
+bool trace_enable_env(void);
+
+/* Stop tracing and print the contents of all rings. */
+void trace_dump(void);
+
+/*
+ * The time on the trace clock in nanoseconds, for coarser timing than
+ * trace() provides, e.g. report.c's; 0 if there is no clock or its
+ * frequency is unknown.
+ */
+u64 trace_clock_ns(void);
+
+static inline void trace(const char *event, u64 arg0, u64 arg1)
+{
+	struct trace_ring *ring = trace_rings;
+	struct trace_entry *e;
+	unsigned long slot;
+
+	if (!ring)
+		return;
+
+	/* Only this CPU writes its ring, but interrupts may nest. */
+	ring += trace_clock.cpu_id();
+	slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+	e = &ring->entries[slot & trace_mask];
+	e->ts = trace_clock.read();
+	e->event = event;
+	e->arg0 = arg0;
+	e->arg1 = arg1;
+}
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * A minimal virtio-blk driver.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "alloc.h"
+#include "virtio.h"
+#include "virtio-blk.h"
+
+/* The driver must not clear status bits the device has accepted */
+static void virtio_blk_add_status(struct virtio_device *vdev, u8 status)
+{
+	vdev->config->set_status(vdev, vdev->config->get_status(vdev) | status);
+}
+
+struct virtio_blk *virtio_blk_bind_queues(unsigned int nr_queues)
+{
+	struct virtio_device *vdev;
+	struct virtio_blk *blk;
+	const char **names;
+	unsigned int i;
+
+	assert(nr_queues);
+
+	vdev = virtio_bind(VIRTIO_ID_BLOCK);
+	if (!vdev)
+		return NULL;
+
+	vdev->config->set_status(vdev, VIRTIO_CONFIG_S_ACKNOWLEDGE |
+				       VIRTIO_CONFIG_S_DRIVER);
+
+	virtio_negotiate_features(vdev, (1ULL << VIRTIO_RING_F_EVENT_IDX) |
+					(1ULL << VIRTIO_BLK_F_FLUSH) |
+					(1ULL << VIRTIO_BLK_F_MQ));
+
+	if (virtio_has_feature(vdev, VIRTIO_F_VERSION_1) &&
+	    !(vdev->config->get_status(vdev) & VIRTIO_CONFIG_S_FEATURES_OK)) {
+		printf("virtio-blk: device rejected the features\n");
+		virtio_blk_add_status(vdev, VIRTIO_CONFIG_S_FAILED);
+		return NULL;
+	}
+
+	if (!virtio_has_feature(vdev, VIRTIO_BLK_F_MQ))
+		nr_queues = 1;
+	else
+		nr_queues = MIN(nr_queues,
+				virtio_config_readw(vdev, VIRTIO_BLK_CFG_NUM_QUEUES));
+
+	blk = calloc(1, sizeof(*blk));
+	blk->vqs = calloc(nr_queues, sizeof(*blk->vqs));
+	names = calloc(nr_queues, sizeof(*names));
+	assert(blk && blk->vqs && names);
+
+	for (i = 0; i < nr_queues; i++)
+		names[i] = "requests";
+
+	if (vdev->config->find_vqs(vdev, nr_queues, blk->vqs, NULL, names) < 0) {
+		virtio_blk_add_status(vdev, VIRTIO_CONFIG_S_FAILED);
+		free(names);
+		free(blk->vqs);
+		free(blk);
+		return NULL;
+	}
+	free(names);
+
+	blk->vdev = vdev;
+	blk->vq = blk->vqs[0];
+	blk->nr_queues = nr_queues;
+	blk->capacity = virtio_config_readl(vdev, VIRTIO_BLK_CFG_CAPACITY) |
+			(u64)virtio_config_readl(vdev, VIRTIO_BLK_CFG_CAPACITY + 4) << 32;
+
+	virtio_blk_add_status(vdev, VIRTIO_CONFIG_S_DRIVER_OK);
+
+	return blk;
+}
+
+struct virtio_blk *virtio_blk_bind(void)
+{
+	return virtio_blk_bind_queues(1);
+}
+
+int virtio_blk_submit_vq(struct virtqueue *vq, struct virtio_blk_req *req,
+			 u32 type, u64 sector, void *data, unsigned int len)
+{
+	struct virtqueue_sg sgs[3];
+	unsigned int out = 1, in = 0;
+
+	assert(len % VIRTIO_BLK_SECTOR_SIZE == 0);
+	assert(type == VIRTIO_BLK_T_FLUSH ? len == 0 : len != 0);
+
+	req->hdr.type = type;
+	req->hdr.ioprio = 0;
+	req->hdr.sector = sector;
+	req->status = 0xff;
+	req->data = data;
+	req->len = len;
+
+	sgs[0].addr = &req->hdr;
+	sgs[0].len = sizeof(req->hdr);
+
+	if (type == VIRTIO_BLK_T_OUT) {
+		sgs[out].addr = data;
+		sgs[out++].len = len;
+	} else if (type == VIRTIO_BLK_T_IN) {
+		sgs[out + in].addr = data;
+		sgs[out + in++].len = len;
+	}
+
+	sgs[out + in].addr = &req->status;
+	sgs[out + in++].len = sizeof(req->status);
+
+	return virtqueue_add_sgs(vq, sgs, out, in, req);
+}
+
+int virtio_blk_submit(struct virtio_blk *blk, struct virtio_blk_req *req,
+		      u32 type, u64 sector, void *data, unsigned int len)
+{
+	return virtio_blk_submit_vq(blk->vq, req, type, sector, data, len);
+}
+
+bool virtio_blk_kick(struct virtio_blk *blk)
+{
+	return virtqueue_kick(blk->vq);
+}
+
+struct virtio_blk_req *virtio_blk_complete(struct virtio_blk *blk)
+{
+	unsigned int len;
+
+	return virtqueue_get_buf(blk->vq, &len);
+}
+
+u8 virtio_blk_io(struct virtio_blk *blk, u32 type, u64 sector,
+		 void *data, unsigned int len)
+{
+	static struct virtio_blk_req req __attribute__((aligned(64)));
+	struct virtio_blk_req *done;
+	unsigned int used;
+
+	if (virtio_blk_submit(blk, &req, type, sector, data, len) < 0)
+		return VIRTIO_BLK_S_IOERR;
+
+	virtio_blk_kick(blk);
+	done = virtqueue_wait_buf(blk->vq, &used);
+	assert(done == &req);
+
+	return req.status;
+}
@@ -0,0 +1,90 @@
+#ifndef _VIRTIO_BLK_H_
+#define _VIRTIO_BLK_H_
+/*
+ * A minimal virtio-blk driver, enough to drive a disk from a benchmark.
+ *
+ * Requests are queued with virtio_blk_submit(), handed to the device in
+ * batches with virtio_blk_kick() and reaped with virtio_blk_complete(),
+ * so a caller keeps any number of them in flight.  Each read or write
+ * takes three descriptors (header, data, status), a flush two.
+ *
+ * Request headers, status bytes and data are handed to the device by
+ * physical address, so each must be physically contiguous, e.g. come
+ * from alloc_pages().
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "virtio.h"
+
+#define VIRTIO_BLK_F_FLUSH	9
+#define VIRTIO_BLK_F_MQ		12
+
+/* Offsets in the device configuration */
+#define VIRTIO_BLK_CFG_CAPACITY		0
+#define VIRTIO_BLK_CFG_NUM_QUEUES	34
+
+#define VIRTIO_BLK_T_IN		0
+#define VIRTIO_BLK_T_OUT	1
+#define VIRTIO_BLK_T_FLUSH	4
+
+#define VIRTIO_BLK_S_OK		0
+#define VIRTIO_BLK_S_IOERR	1
+#define VIRTIO_BLK_S_UNSUPP	2
+
+#define VIRTIO_BLK_SECTOR_SIZE	512
+
+struct virtio_blk_outhdr {
+	u32 type;
+	u32 ioprio;
+	u64 sector;
+};
+
+struct virtio_blk_req {
+	struct virtio_blk_outhdr hdr;
+	u8 status;
+	void *data;
+	unsigned int len;
+	u64 start;		/* free for the caller, e.g. a timestamp */
+};
+
+struct virtio_blk {
+	struct virtio_device *vdev;
+	struct virtqueue *vq;		/* vqs[0] */
+	struct virtqueue **vqs;
+	unsigned int nr_queues;
+	u64 capacity;		/* in VIRTIO_BLK_SECTOR_SIZE sectors */
+};
+
+/* Returns NULL if there is no virtio-blk device */
+extern struct virtio_blk *virtio_blk_bind(void);
+
+/*
+ * As virtio_blk_bind(), but sets up as many request queues as the
+ * device has, up to @nr_queues.
+ */
+extern struct virtio_blk *virtio_blk_bind_queues(unsigned int nr_queues);
+
+/*
+ * Queue @req for the device without notifying it.  @len must be a
+ * multiple of VIRTIO_BLK_SECTOR_SIZE, and 0 for a flush.  Returns -1 if
+ * the virtqueue is full.
+ */
+extern int virtio_blk_submit(struct virtio_blk *blk, struct virtio_blk_req *req,
+			     u32 type, u64 sector, void *data, unsigned int len);
+/* As virtio_blk_submit(), on request queue @vq of the device */
+extern int virtio_blk_submit_vq(struct virtqueue *vq, struct virtio_blk_req *req,
+				u32 type, u64 sector, void *data, unsigned int len);
+extern bool virtio_blk_kick(struct virtio_blk *blk);
+
+/* Returns the next request completed by the device, or NULL if none */
+extern struct virtio_blk_req *virtio_blk_complete(struct virtio_blk *blk);
+
+/*
+ * Runs a single request to completion, returns its status.  No other
+ * requests may be in flight.
+ */
+extern u8 virtio_blk_io(struct virtio_blk *blk, u32 type, u64 sector,
+			void *data, unsigned int len);
+
+#endif /* _VIRTIO_BLK_H_ */
@@ -9,6 +9,7 @@
 #include "devicetree.h"
 #include "alloc_page.h"
 #include "alloc.h"
+#include "slab.h"
 #include "asm/page.h"
 #include "asm/io.h"
 #include "virtio.h"
@@ -43,6 +44,46 @@ static bool vm_notify(struct virtqueue *vq)
 	return true;
 }
 
+static u64 vm_get_features(struct virtio_device *vdev)
+{
+	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
+	u64 features;
+
+	writel(1, vm_dev->base + VIRTIO_MMIO_HOST_FEATURES_SEL);
+	features = readl(vm_dev->base + VIRTIO_MMIO_HOST_FEATURES);
+	features <<= 32;
+
+	writel(0, vm_dev->base + VIRTIO_MMIO_HOST_FEATURES_SEL);
+	features |= readl(vm_dev->base + VIRTIO_MMIO_HOST_FEATURES);
+
+	return features;
+}
+
+static void vm_finalize_features(struct virtio_device *vdev)
+{
+	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
+
+	writel(1, vm_dev->base + VIRTIO_MMIO_GUEST_FEATURES_SEL);
+	writel((u32)(vdev->features >> 32), vm_dev->base + VIRTIO_MMIO_GUEST_FEATURES);
+
+	writel(0, vm_dev->base + VIRTIO_MMIO_GUEST_FEATURES_SEL);
+	writel((u32)vdev->features, vm_dev->base + VIRTIO_MMIO_GUEST_FEATURES);
+}
+
+static u8 vm_get_status(struct virtio_device *vdev)
+{
+	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
+	return readl(vm_dev->base + VIRTIO_MMIO_STATUS) & 0xff;
+}
+
+static void vm_set_status(struct virtio_device *vdev, u8 status)
+{
+	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
+	writel(status, vm_dev->base + VIRTIO_MMIO_STATUS);
+}
+
+static struct kmem_cache *vq_cache;
+
 static struct virtqueue *vm_setup_vq(struct virtio_device *vdev,
 				     unsigned index,
 				     void (*callback)(struct virtqueue *vq),
@@ -53,10 +94,18 @@ static struct virtqueue *vm_setup_vq(struct virtio_device *vdev,
 	void *queue;
 	unsigned num = VIRTIO_MMIO_QUEUE_NUM_MIN;
 
-	vq = calloc(1, sizeof(*vq));
+	/* vring_init_virtqueue() fills in data[] for all num descriptors */
+	if (!vq_cache)
+		vq_cache = kmem_cache_create("virtqueue",
+					     sizeof(*vq) + num * sizeof(vq->data[0]),
+					     0, 0);
+	assert(vq_cache);
+
+	vq = kmem_cache_zalloc(vq_cache);
 	assert(VIRTIO_MMIO_QUEUE_SIZE_MIN <= 2*PAGE_SIZE);
 	queue = alloc_pages(1);
 	assert(vq && queue);
+	memset(queue, 0, VIRTIO_MMIO_QUEUE_SIZE_MIN);
 
 	writel(index, vm_dev->base + VIRTIO_MMIO_QUEUE_SEL);
 
@@ -100,6 +149,10 @@ static const struct virtio_config_ops vm_config_ops = {
 	.get = vm_get,
 	.set = vm_set,
 	.find_vqs = vm_find_vqs,
+	.get_features = vm_get_features,
+	.finalize_features = vm_finalize_features,
+	.get_status = vm_get_status,
+	.set_status = vm_set_status,
 };
 
 static void vm_device_init(struct virtio_mmio_device *vm_dev)
@@ -0,0 +1,318 @@
+/*
+ * virtio 1.x PCI transport, adapted from the Linux kernel.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "alloc_page.h"
+#include "alloc.h"
+#include "slab.h"
+#include "pci.h"
+#include "asm/page.h"
+#include "asm/io.h"
+#include "asm/pci.h"
+#include "linux/pci_regs.h"
+#include "virtio.h"
+#include "virtio-pci.h"
+
+static void vp_get(struct virtio_device *vdev, unsigned offset,
+		   void *buf, unsigned len)
+{
+	struct virtio_pci_device *vp_dev = to_virtio_pci_device(vdev);
+	u8 *p = buf;
+	unsigned i;
+	u8 gen;
+
+	assert(vp_dev->device);
+
+	/* Retry if the device changed the configuration under us */
+	do {
+		gen = readb(vp_dev->common + VIRTIO_PCI_COMMON_CFGGENERATION);
+		for (i = 0; i < len; ++i)
+			p[i] = readb(vp_dev->device + offset + i);
+	} while (gen != readb(vp_dev->common + VIRTIO_PCI_COMMON_CFGGENERATION));
+}
+
+static void vp_set(struct virtio_device *vdev, unsigned offset,
+		   const void *buf, unsigned len)
+{
+	struct virtio_pci_device *vp_dev = to_virtio_pci_device(vdev);
+	const u8 *p = buf;
+	unsigned i;
+
+	assert(vp_dev->device);
+
+	for (i = 0; i < len; ++i)
+		writeb(p[i], vp_dev->device + offset + i);
+}
+
+static u64 vp_get_features(struct virtio_device *vdev)
+{
+	struct virtio_pci_device *vp_dev = to_virtio_pci_device(vdev);
+	u64 features;
+
+	writel(1, vp_dev->common + VIRTIO_PCI_COMMON_DFSELECT);
+	features = readl(vp_dev->common + VIRTIO_PCI_COMMON_DF);
+	features <<= 32;
+
+	writel(0, vp_dev->common + VIRTIO_PCI_COMMON_DFSELECT);
+	features |= readl(vp_dev->common + VIRTIO_PCI_COMMON_DF);
+
+	return features;
+}
+
+static u8 vp_get_status(struct virtio_device *vdev)
+{
+	struct virtio_pci_device *vp_dev = to_virtio_pci_device(vdev);
+	return readb(vp_dev->common + VIRTIO_PCI_COMMON_STATUS);
+}
+
+static void vp_set_status(struct virtio_device *vdev, u8 status)
+{
+	struct virtio_pci_device *vp_dev = to_virtio_pci_device(vdev);
+	writeb(status, vp_dev->common + VIRTIO_PCI_COMMON_STATUS);
+}
+
+static void vp_finalize_features(struct virtio_device *vdev)
+{
+	struct virtio_pci_device *vp_dev = to_virtio_pci_device(vdev);
+	u8 status;
+
+	/* The transport's own feature, a modern device must offer it */
+	vdev->features |= 1ULL << VIRTIO_F_VERSION_1;
+
+	writel(1, vp_dev->common + VIRTIO_PCI_COMMON_GFSELECT);
+	writel((u32)(vdev->features >> 32), vp_dev->common + VIRTIO_PCI_COMMON_GF);
+
+	writel(0, vp_dev->common + VIRTIO_PCI_COMMON_GFSELECT);
+	writel((u32)vdev->features, vp_dev->common + VIRTIO_PCI_COMMON_GF);
+
+	/* The device clears it again if it rejects the features */
+	status = vp_get_status(vdev) | VIRTIO_CONFIG_S_FEATURES_OK;
+	vp_set_status(vdev, status);
+}
+
+static bool vp_notify(struct virtqueue *vq)
+{
+	writew(vq->index, vq->priv);
+	return true;
+}
+
+static struct kmem_cache *vq_cache;
+
+static struct virtqueue *vp_setup_vq(struct virtio_device *vdev,
+				     unsigned index,
+				     void (*callback)(struct virtqueue *vq),
+				     const char *name)
+{
+	struct virtio_pci_device *vp_dev = to_virtio_pci_device(vdev);
+	void *common = vp_dev->common;
+	struct vring_virtqueue *vq;
+	unsigned num = VIRTIO_PCI_QUEUE_NUM;
+	u16 vector = VIRTIO_MSI_NO_VECTOR;
+	u16 off;
+	void *queue;
+
+	if (!vq_cache)
+		vq_cache = kmem_cache_create("virtqueue-pci",
+					     sizeof(*vq) + num * sizeof(vq->data[0]),
+					     0, 0);
+	assert(vq_cache);
+
+	writew(index, common + VIRTIO_PCI_COMMON_Q_SELECT);
+
+	num = MIN(num, readw(common + VIRTIO_PCI_COMMON_Q_SIZE));
+	if (!num || (num & (num - 1))) {
+		printf("%s: virtqueue %d has size %d\n", __func__, index, num);
+		return NULL;
+	}
+
+	if (readw(common + VIRTIO_PCI_COMMON_Q_ENABLE)) {
+		printf("%s: virtqueue %d already setup!\n", __func__, index);
+		return NULL;
+	}
+
+	vq = kmem_cache_zalloc(vq_cache);
+	queue = alloc_pages(1);
+	assert(vq && queue);
+	memset(queue, 0, VIRTIO_PCI_QUEUE_SIZE);
+
+	vring_init_virtqueue(vq, index, num, VIRTIO_PCI_VRING_ALIGN,
+			     vdev, queue, vp_notify, callback, name);
+
+	writew(num, common + VIRTIO_PCI_COMMON_Q_SIZE);
+	writel((u32)virt_to_phys(vq->vring.desc), common + VIRTIO_PCI_COMMON_Q_DESCLO);
+	writel((u32)((u64)virt_to_phys(vq->vring.desc) >> 32),
+	       common + VIRTIO_PCI_COMMON_Q_DESCHI);
+	writel((u32)virt_to_phys(vq->vring.avail), common + VIRTIO_PCI_COMMON_Q_AVAILLO);
+	writel((u32)((u64)virt_to_phys(vq->vring.avail) >> 32),
+	       common + VIRTIO_PCI_COMMON_Q_AVAILHI);
+	writel((u32)virt_to_phys(vq->vring.used), common + VIRTIO_PCI_COMMON_Q_USEDLO);
+	writel((u32)((u64)virt_to_phys(vq->vring.used) >> 32),
+	       common + VIRTIO_PCI_COMMON_Q_USEDHI);
+
+	if (vp_dev->msix) {
+		vector = virtio_pci_vq_msix_entry(&vq->vq);
+		writew(vector, common + VIRTIO_PCI_COMMON_Q_MSIX);
+		if (readw(common + VIRTIO_PCI_COMMON_Q_MSIX) != vector) {
+			printf("%s: virtqueue %d can't use MSI-X entry %d\n",
+			       __func__, index, vector);
+			return NULL;
+		}
+	} else {
+		writew(vector, common + VIRTIO_PCI_COMMON_Q_MSIX);
+	}
+
+	off = readw(common + VIRTIO_PCI_COMMON_Q_NOFF);
+	vq->vq.priv = vp_dev->notify_base + off * vp_dev->notify_off_multiplier;
+
+	writew(1, common + VIRTIO_PCI_COMMON_Q_ENABLE);
+
+	return &vq->vq;
+}
+
+static int vp_find_vqs(struct virtio_device *vdev, unsigned nvqs,
+		       struct virtqueue *vqs[], vq_callback_t *callbacks[],
+		       const char *names[])
+{
+	struct virtio_pci_device *vp_dev = to_virtio_pci_device(vdev);
+	u16 vector = VIRTIO_MSI_NO_VECTOR;
+	unsigned i;
+
+	if (nvqs > readw(vp_dev->common + VIRTIO_PCI_COMMON_NUMQ))
+		return -1;
+
+	/* One entry for configuration changes and one per virtqueue */
+	vp_dev->msix = pci_msix_table_size(&vp_dev->pci_dev) >= nvqs + 1;
+	if (vp_dev->msix)
+		vector = VIRTIO_MSI_CONFIG_VECTOR;
+	writew(vector, vp_dev->common + VIRTIO_PCI_COMMON_MSIX);
+
+	for (i = 0; i < nvqs; ++i) {
+		vqs[i] = vp_setup_vq(vdev, i,
+				     callbacks ? callbacks[i] : NULL,
+				     names ? names[i] : "");
+		if (vqs[i] == NULL)
+			return -1;
+	}
+
+	return 0;
+}
+
+static const struct virtio_config_ops vp_config_ops = {
+	.get = vp_get,
+	.set = vp_set,
+	.find_vqs = vp_find_vqs,
+	.get_features = vp_get_features,
+	.finalize_features = vp_finalize_features,
+	.get_status = vp_get_status,
+	.set_status = vp_set_status,
+};
+
+static void vp_cap_setup(struct pci_dev *dev, int cap_offset, int cap_id)
+{
+	struct virtio_pci_device *vp_dev =
+		container_of(dev, struct virtio_pci_device, pci_dev);
+	u8 type, bar;
+	u32 offset, length;
+	void *p;
+
+	if (cap_id != PCI_CAP_ID_VNDR)
+		return;
+
+	type = pci_config_readb(dev->bdf, cap_offset + VIRTIO_PCI_CAP_CFG_TYPE);
+	bar = pci_config_readb(dev->bdf, cap_offset + VIRTIO_PCI_CAP_BAR);
+	offset = pci_config_readl(dev->bdf, cap_offset + VIRTIO_PCI_CAP_OFFSET);
+	length = pci_config_readl(dev->bdf, cap_offset + VIRTIO_PCI_CAP_LENGTH);
+
+	if (type > VIRTIO_PCI_CAP_DEVICE_CFG || bar >= PCI_BAR_NUM ||
+	    !pci_bar_is_valid(dev, bar) || !pci_bar_is_memory(dev, bar))
+		return;
+
+	/* The first capability of each type is the preferred one */
+	switch (type) {
+	case VIRTIO_PCI_CAP_COMMON_CFG:
+		if (vp_dev->common)
+			return;
+		break;
+	case VIRTIO_PCI_CAP_NOTIFY_CFG:
+		if (vp_dev->notify_base)
+			return;
+		break;
+	case VIRTIO_PCI_CAP_DEVICE_CFG:
+		if (vp_dev->device)
+			return;
+		break;
+	default:
+		return;
+	}
+
+	p = ioremap(pci_bar_get_addr(dev, bar) + offset, length);
+
+	switch (type) {
+	case VIRTIO_PCI_CAP_COMMON_CFG:
+		vp_dev->common = p;
+		break;
+	case VIRTIO_PCI_CAP_NOTIFY_CFG:
+		vp_dev->notify_base = p;
+		vp_dev->notify_off_multiplier =
+			pci_config_readl(dev->bdf, cap_offset + VIRTIO_PCI_NOTIFY_CAP_MULT);
+		break;
+	case VIRTIO_PCI_CAP_DEVICE_CFG:
+		vp_dev->device = p;
+		break;
+	}
+}
+
+static bool vp_match(pcidevaddr_t bdf, u32 devid)
+{
+	u16 device;
+
+	if (pci_config_readw(bdf, PCI_VENDOR_ID) != PCI_VENDOR_ID_REDHAT_QUMRANET)
+		return false;
+
+	device = pci_config_readw(bdf, PCI_DEVICE_ID);
+	if (device == VIRTIO_PCI_DEVICE_ID_MODERN + devid)
+		return true;
+
+	return device >= VIRTIO_PCI_DEVICE_ID_TRANS_MIN &&
+	       device <= VIRTIO_PCI_DEVICE_ID_TRANS_MAX &&
+	       pci_config_readw(bdf, PCI_SUBSYSTEM_ID) == devid;
+}
+
+struct virtio_device *virtio_pci_bind(u32 devid)
+{
+	struct virtio_pci_device *vp_dev;
+	pcidevaddr_t bdf;
+
+	for (bdf = 0; bdf < PCI_DEVFN_MAX; ++bdf) {
+		if (!vp_match(bdf, devid))
+			continue;
+
+		vp_dev = calloc(1, sizeof(*vp_dev));
+		assert(vp_dev != NULL);
+
+		pci_dev_init(&vp_dev->pci_dev, bdf);
+		pci_enable_defaults(&vp_dev->pci_dev);
+		pci_cap_walk(&vp_dev->pci_dev, vp_cap_setup);
+
+		if (!vp_dev->common || !vp_dev->notify_base) {
+			/* Legacy only */
+			free(vp_dev);
+			continue;
+		}
+
+		vp_dev->vdev.id.device = devid;
+		vp_dev->vdev.id.vendor = pci_config_readw(bdf, PCI_SUBSYSTEM_VENDOR_ID);
+		vp_dev->vdev.config = &vp_config_ops;
+
+		/* Reset, in case firmware drove the device */
+		vp_set_status(&vp_dev->vdev, 0);
+		while (vp_get_status(&vp_dev->vdev))
+			cpu_relax();
+
+		return &vp_dev->vdev;
+	}
+
+	return NULL;
+}
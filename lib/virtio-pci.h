@@ -0,0 +1,94 @@
+#ifndef _VIRTIO_PCI_H_
+#define _VIRTIO_PCI_H_
+/*
+ * A minimal implementation of the virtio 1.x (modern) PCI transport.
+ * Adapted from the Linux Kernel.
+ *
+ * Devices are found on PCI bus 0, either as modern-only devices
+ * (0x1040 + virtio device id) or as transitional ones, which also carry
+ * the modern capabilities.  The legacy I/O port interface is not
+ * supported.  The BARs are mapped with ioremap(), so x86 tests must
+ * have called setup_vm() first.
+ *
+ * If the device has enough MSI-X table entries, entry 0 is assigned to
+ * configuration changes and entry 1 + n to virtqueue n.  The entries
+ * are left masked; a test that wants interrupts programs them with
+ * pci_setup_msix() on the vp_dev->pci_dev of to_virtio_pci_device().
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "asm/page.h"
+#include "pci.h"
+#include "virtio.h"
+
+#define PCI_VENDOR_ID_REDHAT_QUMRANET	0x1af4
+#define VIRTIO_PCI_DEVICE_ID_TRANS_MIN	0x1000
+#define VIRTIO_PCI_DEVICE_ID_TRANS_MAX	0x103f
+#define VIRTIO_PCI_DEVICE_ID_MODERN	0x1040
+
+/* Vendor capability types */
+#define VIRTIO_PCI_CAP_COMMON_CFG	1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG	2
+#define VIRTIO_PCI_CAP_ISR_CFG		3
+#define VIRTIO_PCI_CAP_DEVICE_CFG	4
+#define VIRTIO_PCI_CAP_PCI_CFG		5
+
+/* Offsets in the vendor capability */
+#define VIRTIO_PCI_CAP_CFG_TYPE		3
+#define VIRTIO_PCI_CAP_BAR		4
+#define VIRTIO_PCI_CAP_OFFSET		8
+#define VIRTIO_PCI_CAP_LENGTH		12
+#define VIRTIO_PCI_NOTIFY_CAP_MULT	16
+
+/* Offsets in the common configuration structure */
+#define VIRTIO_PCI_COMMON_DFSELECT	0
+#define VIRTIO_PCI_COMMON_DF		4
+#define VIRTIO_PCI_COMMON_GFSELECT	8
+#define VIRTIO_PCI_COMMON_GF		12
+#define VIRTIO_PCI_COMMON_MSIX		16
+#define VIRTIO_PCI_COMMON_NUMQ		18
+#define VIRTIO_PCI_COMMON_STATUS	20
+#define VIRTIO_PCI_COMMON_CFGGENERATION	21
+#define VIRTIO_PCI_COMMON_Q_SELECT	22
+#define VIRTIO_PCI_COMMON_Q_SIZE	24
+#define VIRTIO_PCI_COMMON_Q_MSIX	26
+#define VIRTIO_PCI_COMMON_Q_ENABLE	28
+#define VIRTIO_PCI_COMMON_Q_NOFF	30
+#define VIRTIO_PCI_COMMON_Q_DESCLO	32
+#define VIRTIO_PCI_COMMON_Q_DESCHI	36
+#define VIRTIO_PCI_COMMON_Q_AVAILLO	40
+#define VIRTIO_PCI_COMMON_Q_AVAILHI	44
+#define VIRTIO_PCI_COMMON_Q_USEDLO	48
+#define VIRTIO_PCI_COMMON_Q_USEDHI	52
+
+#define VIRTIO_MSI_NO_VECTOR		0xffff
+#define VIRTIO_MSI_CONFIG_VECTOR	0
+
+/* Same ring size and layout as virtio-mmio, see virtio-mmio.h */
+#define VIRTIO_PCI_VRING_ALIGN		PAGE_SIZE
+#define VIRTIO_PCI_QUEUE_SIZE		(2*VIRTIO_PCI_VRING_ALIGN)
+#define VIRTIO_PCI_QUEUE_NUM		128
+
+#define to_virtio_pci_device(vdev_ptr) \
+	container_of(vdev_ptr, struct virtio_pci_device, vdev)
+
+struct virtio_pci_device {
+	struct virtio_device vdev;
+	struct pci_dev pci_dev;
+	void *common;
+	void *notify_base;
+	u32 notify_off_multiplier;
+	void *device;
+	bool msix;		/* virtqueues are assigned MSI-X entries */
+};
+
+/* The MSI-X table entry of @vq, if vp_dev->msix */
+static inline unsigned int virtio_pci_vq_msix_entry(struct virtqueue *vq)
+{
+	return vq->index + 1;
+}
+
+extern struct virtio_device *virtio_pci_bind(u32 devid);
+
+#endif /* _VIRTIO_PCI_H_ */
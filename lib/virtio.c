@@ -9,6 +9,7 @@
 #include "asm/io.h"
 #include "virtio.h"
 #include "virtio-mmio.h"
+#include "virtio-pci.h"
 
 void vring_init(struct vring *vr, unsigned int num, void *p,
 		       unsigned long align)
@@ -36,7 +37,9 @@ void vring_init_virtqueue(struct vring_virtqueue *vq, unsigned index,
 	vq->vq.num_free = num;
 	vq->vq.index = index;
 	vq->notify = notify;
+	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
 	vq->last_used_idx = 0;
+	vq->avail_idx_shadow = 0;
 	vq->num_added = 0;
 	vq->free_head = 0;
 
@@ -47,46 +50,137 @@ void vring_init_virtqueue(struct vring_virtqueue *vq, unsigned index,
 	vq->data[i] = NULL;
 }
 
-int virtqueue_add_outbuf(struct virtqueue *_vq, char *buf, unsigned int len)
+/*
+ * Chain sgs[0 .. out_sgs-1] (read by the device) and then
+ * sgs[out_sgs .. out_sgs+in_sgs-1] (written by the device) into one
+ * request.  data is returned by virtqueue_get_buf() once the device
+ * has used the request.
+ */
+int virtqueue_add_sgs(struct virtqueue *_vq, struct virtqueue_sg sgs[],
+		      unsigned int out_sgs, unsigned int in_sgs, void *data)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int total = out_sgs + in_sgs;
+	unsigned int n, i, prev = 0;
 	unsigned avail;
 	int head;
 
-	assert(buf != NULL);
-	assert(len != 0);
+	assert(data != NULL);
+	assert(total != 0);
 
-	if (!vq->vq.num_free)
+	if (vq->vq.num_free < total)
 		return -1;
 
-	--vq->vq.num_free;
+	vq->vq.num_free -= total;
 
-	head = vq->free_head;
+	head = i = vq->free_head;
 
-	vq->vring.desc[head].flags = 0;
-	vq->vring.desc[head].addr = virt_to_phys(buf);
-	vq->vring.desc[head].len = len;
+	for (n = 0; n < total; n++) {
+		assert(sgs[n].addr != NULL);
+		assert(sgs[n].len != 0);
+		vq->vring.desc[i].flags = VRING_DESC_F_NEXT;
+		if (n >= out_sgs)
+			vq->vring.desc[i].flags |= VRING_DESC_F_WRITE;
+		vq->vring.desc[i].addr = virt_to_phys(sgs[n].addr);
+		vq->vring.desc[i].len = sgs[n].len;
+		prev = i;
+		i = vq->vring.desc[i].next;
+	}
+	vq->vring.desc[prev].flags &= ~VRING_DESC_F_NEXT;
 
-	vq->free_head = vq->vring.desc[head].next;
+	vq->free_head = i;
 
-	vq->data[head] = buf;
+	vq->data[head] = data;
 
-	avail = (vq->vring.avail->idx & (vq->vring.num-1));
+	avail = (vq->avail_idx_shadow & (vq->vring.num-1));
 	vq->vring.avail->ring[avail] = head;
-	wmb();
-	vq->vring.avail->idx++;
+	vq->avail_idx_shadow++;
 	vq->num_added++;
 
 	return 0;
 }
 
-bool virtqueue_kick(struct virtqueue *_vq)
+int virtqueue_add_outbuf(struct virtqueue *_vq, char *buf, unsigned int len)
+{
+	struct virtqueue_sg sg = { buf, len };
+
+	return virtqueue_add_sgs(_vq, &sg, 1, 0, buf);
+}
+
+int virtqueue_add_inbuf(struct virtqueue *_vq, char *buf, unsigned int len)
+{
+	struct virtqueue_sg sg = { buf, len };
+
+	return virtqueue_add_sgs(_vq, &sg, 0, 1, buf);
+}
+
+/*
+ * Publish the buffers added since the last call to the device and
+ * return whether it wants to be notified of them.
+ */
+bool virtqueue_kick_prepare(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
+	u16 new, old;
+
+	new = vq->avail_idx_shadow;
+	old = new - vq->num_added;
+	vq->num_added = 0;
+
+	/* Descriptors and ring entries before the index that exposes them */
+	wmb();
+	vq->vring.avail->idx = new;
+	/* The new index before the device's notification suppression state */
 	mb();
+
+	if (vq->event)
+		return vring_need_event(vring_avail_event(&vq->vring), new, old);
+
+	return !(vq->vring.used->flags & VRING_USED_F_NO_NOTIFY);
+}
+
+bool virtqueue_notify(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
 	return vq->notify(_vq);
 }
 
+bool virtqueue_kick(struct virtqueue *_vq)
+{
+	if (virtqueue_kick_prepare(_vq))
+		return virtqueue_notify(_vq);
+	return true;
+}
+
+void virtqueue_disable_cb(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	vq->vring.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+	/*
+	 * With event-idx the flag is ignored, ask for an interrupt at an
+	 * index the device has already passed, i.e. only after it wrapped.
+	 */
+	if (vq->event)
+		vring_used_event(&vq->vring) = vq->last_used_idx - 1;
+}
+
+/*
+ * Re-enable interrupts, returns false if used buffers are already
+ * pending, which the device may not interrupt for.
+ */
+bool virtqueue_enable_cb(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+
+	vq->vring.avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+	if (vq->event)
+		vring_used_event(&vq->vring) = vq->last_used_idx;
+	mb();
+
+	return !virtqueue_more_used(_vq);
+}
+
 void detach_buf(struct vring_virtqueue *vq, unsigned head)
 {
 	unsigned i = head;
@@ -103,6 +197,16 @@ void detach_buf(struct vring_virtqueue *vq, unsigned head)
 	vq->vq.num_free++;
 }
 
+bool virtqueue_more_used(struct virtqueue *_vq)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	return vq->last_used_idx != READ_ONCE(vq->vring.used->idx);
+}
+
+/*
+ * Return the data of the next request used by the device, and in *len
+ * the number of bytes it wrote, or NULL if there is none yet.
+ */
 void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
@@ -110,21 +214,61 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 	unsigned i;
 	void *ret;
 
+	if (!virtqueue_more_used(_vq))
+		return NULL;
+
+	/* The used index before the used ring entry it exposes */
 	rmb();
 
 	last_used = (vq->last_used_idx & (vq->vring.num-1));
 	i = vq->vring.used->ring[last_used].id;
 	*len = vq->vring.used->ring[last_used].len;
 
+	assert(i < vq->vring.num && vq->data[i]);
 	ret = vq->data[i];
 	detach_buf(vq, i);
 
 	vq->last_used_idx++;
 
+	if (vq->event && !(vq->vring.avail->flags & VRING_AVAIL_F_NO_INTERRUPT))
+		vring_used_event(&vq->vring) = vq->last_used_idx;
+
 	return ret;
 }
 
+/* Busy-poll the used ring for the next request, see virtqueue_get_buf() */
+void *virtqueue_wait_buf(struct virtqueue *_vq, unsigned int *len)
+{
+	void *ret;
+
+	while (!(ret = virtqueue_get_buf(_vq, len)))
+		cpu_relax();
+
+	return ret;
+}
+
+/*
+ * Accept the features both the device and the caller support, must be
+ * called before the virtqueues are set up.
+ */
+u64 virtio_negotiate_features(struct virtio_device *vdev, u64 features)
+{
+	vdev->features = vdev->config->get_features(vdev) & features;
+	vdev->config->finalize_features(vdev);
+	return vdev->features;
+}
+
 struct virtio_device *virtio_bind(u32 devid)
 {
-	return virtio_mmio_bind(devid);
+#if defined(__arm__) || defined(__aarch64__)
+	struct virtio_device *vdev = virtio_mmio_bind(devid);
+
+	if (vdev)
+		return vdev;
+
+	/* Assign the BARs, the firmware did not */
+	if (!pci_probe())
+		return NULL;
+#endif
+	return virtio_pci_bind(devid);
 }
@@ -10,8 +10,18 @@
  */
 #include "libcflat.h"
 
+#define VIRTIO_ID_BLOCK 2
 #define VIRTIO_ID_CONSOLE 3
 
+#define VIRTIO_CONFIG_S_ACKNOWLEDGE	1
+#define VIRTIO_CONFIG_S_DRIVER		2
+#define VIRTIO_CONFIG_S_DRIVER_OK	4
+#define VIRTIO_CONFIG_S_FEATURES_OK	8
+#define VIRTIO_CONFIG_S_FAILED		0x80
+
+/* Set by virtio 1.x devices, which only take features with FEATURES_OK */
+#define VIRTIO_F_VERSION_1		32
+
 struct virtio_device_id {
 	u32 device;
 	u32 vendor;
@@ -20,6 +30,7 @@ struct virtio_device_id {
 struct virtio_device {
 	struct virtio_device_id id;
 	const struct virtio_config_ops *config;
+	u64 features;
 };
 
 struct virtqueue {
@@ -41,8 +52,18 @@ struct virtio_config_ops {
 			struct virtqueue *vqs[],
 			vq_callback_t *callbacks[],
 			const char *names[]);
+	u64 (*get_features)(struct virtio_device *vdev);
+	void (*finalize_features)(struct virtio_device *vdev);
+	u8 (*get_status)(struct virtio_device *vdev);
+	void (*set_status)(struct virtio_device *vdev, u8 status);
 };
 
+static inline bool
+virtio_has_feature(const struct virtio_device *vdev, unsigned int fbit)
+{
+	return vdev->features & (1ULL << fbit);
+}
+
 static inline u8
 virtio_config_readb(struct virtio_device *vdev, unsigned offset)
 {
@@ -88,6 +109,19 @@ virtio_config_writel(struct virtio_device *vdev, unsigned offset, u32 val)
 #define VRING_DESC_F_NEXT	1
 #define VRING_DESC_F_WRITE	2
 
+/* The driver does not want interrupts (a hint, see event-idx below) */
+#define VRING_AVAIL_F_NO_INTERRUPT	1
+/* The device does not want kicks (a hint, see event-idx below) */
+#define VRING_USED_F_NO_NOTIFY		1
+
+/*
+ * With VIRTIO_RING_F_EVENT_IDX negotiated the flags above are ignored,
+ * instead each side publishes the ring index at which it next wants to
+ * be notified: the driver in the used_event field after the avail ring,
+ * the device in the avail_event field after the used ring.
+ */
+#define VIRTIO_RING_F_EVENT_IDX		29
+
 struct vring_desc {
 	u64 addr;
 	u32 len;
@@ -119,18 +153,38 @@ struct vring {
 	struct vring_used *used;
 };
 
+#define vring_used_event(vr)	((vr)->avail->ring[(vr)->num])
+#define vring_avail_event(vr)	(*(u16 *)&(vr)->used->ring[(vr)->num])
+
+/*
+ * Whether moving a ring index from old to new_idx crossed the index
+ * event_idx the other side asked to be notified at.
+ */
+static inline bool vring_need_event(u16 event_idx, u16 new_idx, u16 old)
+{
+	return (u16)(new_idx - event_idx - 1) < (u16)(new_idx - old);
+}
+
 struct vring_virtqueue {
 	struct virtqueue vq;
 	struct vring vring;
 	unsigned int free_head;
 	unsigned int num_added;
+	u16 avail_idx_shadow;
 	u16 last_used_idx;
+	bool event;
 	bool (*notify)(struct virtqueue *vq);
 	void *data[];
 };
 
 #define to_vvq(_vq) container_of(_vq, struct vring_virtqueue, vq)
 
+/* One buffer of a virtqueue_add_sgs() request */
+struct virtqueue_sg {
+	void *addr;
+	unsigned int len;
+};
+
 extern void vring_init(struct vring *vr, unsigned int num, void *p,
 		       unsigned long align);
 extern void vring_init_virtqueue(struct vring_virtqueue *vq, unsigned index,
@@ -139,11 +193,33 @@ extern void vring_init_virtqueue(struct vring_virtqueue *vq, unsigned index,
 				 bool (*notify)(struct virtqueue *),
 				 void (*callback)(struct virtqueue *),
 				 const char *name);
+
+/*
+ * Buffers are added to the avail ring, but only made visible to the
+ * device by virtqueue_kick(), or virtqueue_kick_prepare() followed by
+ * virtqueue_notify(), so a batch of requests costs a single notification
+ * (none at all if the device asked not to be notified).
+ */
+extern int virtqueue_add_sgs(struct virtqueue *vq, struct virtqueue_sg sgs[],
+			     unsigned int out_sgs, unsigned int in_sgs,
+			     void *data);
 extern int virtqueue_add_outbuf(struct virtqueue *vq, char *buf,
 				unsigned int len);
+extern int virtqueue_add_inbuf(struct virtqueue *vq, char *buf,
+			       unsigned int len);
+extern bool virtqueue_kick_prepare(struct virtqueue *vq);
+extern bool virtqueue_notify(struct virtqueue *vq);
 extern bool virtqueue_kick(struct virtqueue *vq);
+
+extern void virtqueue_disable_cb(struct virtqueue *vq);
+extern bool virtqueue_enable_cb(struct virtqueue *vq);
+
 extern void detach_buf(struct vring_virtqueue *vq, unsigned head);
+extern bool virtqueue_more_used(struct virtqueue *vq);
 extern void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len);
+extern void *virtqueue_wait_buf(struct virtqueue *vq, unsigned int *len);
+
+extern u64 virtio_negotiate_features(struct virtio_device *vdev, u64 features);
 
 extern struct virtio_device *virtio_bind(u32 devid);
 
@@ -45,6 +45,13 @@ static inline void outl(uint32_t value, unsigned long port)
     asm volatile("outl %0, %w1" : : "a"(value), "Nd"((unsigned short)port));
 }
 
+static inline void outsb(const void *buf, unsigned long count,
+			 unsigned long port)
+{
+    asm volatile("rep outsb" : "+S"(buf), "+c"(count)
+		 : "d"((unsigned short)port) : "memory");
+}
+
 #define virt_to_phys virt_to_phys
 static inline unsigned long virt_to_phys(const void *virt)
 {
@@ -60,6 +67,8 @@ static inline void *phys_to_virt(unsigned long phys)
 #define ioremap ioremap
 void __iomem *ioremap(phys_addr_t phys_addr, size_t size);
 
+void setup_console(void);
+
 #include <asm-generic/io.h>
 
 #endif
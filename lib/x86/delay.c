@@ -1,5 +1,10 @@
 #include "delay.h"
 #include "processor.h"
+#include "acpi.h"
+#include "asm/io.h"
+
+#define PM_TIMER_HZ	3579545
+#define PM_TIMER_MASK	0xffffff
 
 void delay(u64 count)
 {
@@ -9,3 +14,36 @@ void delay(u64 count)
 		pause();
 	} while (rdtsc() - start < count);
 }
+
+u64 tsc_hz(void)
+{
+	static u64 hz;
+	struct fadt_descriptor_rev1 *fadt;
+	u32 port, p0, p1, p;
+	u64 t0, t1;
+
+	if (hz)
+		return hz;
+
+	fadt = find_acpi_table_addr(FACP_SIGNATURE);
+	if (!fadt || !fadt->pm_tmr_blk)
+		return 0;
+	port = fadt->pm_tmr_blk;
+
+	/*
+	 * Start on a PM timer edge and count TSC ticks for 50ms worth of
+	 * PM timer ticks.  Only the low 24 bits of the PM timer are
+	 * guaranteed, which wrap after more than 4 seconds.
+	 */
+	p0 = inl(port) & PM_TIMER_MASK;
+	while ((p1 = inl(port) & PM_TIMER_MASK) == p0)
+		;
+	t0 = rdtsc();
+	do {
+		p = inl(port) & PM_TIMER_MASK;
+	} while (((p - p1) & PM_TIMER_MASK) < PM_TIMER_HZ / 20);
+	t1 = rdtsc();
+
+	hz = (t1 - t0) * PM_TIMER_HZ / ((p - p1) & PM_TIMER_MASK);
+	return hz;
+}
@@ -7,6 +7,12 @@
 
 void delay(u64 count);
 
+/*
+ * Returns the TSC frequency in Hz, calibrated against the ACPI PM timer
+ * on first use, or 0 if there is no PM timer.
+ */
+u64 tsc_hz(void);
+
 static inline void io_delay(void)
 {
 	delay(IPI_DELAY);
@@ -1,6 +1,7 @@
 #include "fwcfg.h"
 #include "smp.h"
 #include "libcflat.h"
+#include "asm/io.h"
 
 static struct spinlock lock;
 
@@ -81,3 +82,48 @@ unsigned fwcfg_get_nb_cpus(void)
 {
     return fwcfg_get_u16(FW_CFG_NB_CPUS);
 }
+
+struct fwcfg_file {
+	uint32_t size;		/* big endian, as the rest of the directory */
+	uint16_t select;
+	uint16_t reserved;
+	char name[56];
+};
+
+static void fwcfg_read_bytes(void *buf, uint32_t len)
+{
+	uint8_t *p = buf;
+
+	while (len--)
+		*p++ = inb(BIOS_CFG_IOPORT + 1);
+}
+
+void fwcfg_read(uint16_t select, void *buf, uint32_t len)
+{
+	spin_lock(&lock);
+	outw(select, BIOS_CFG_IOPORT);
+	fwcfg_read_bytes(buf, len);
+	spin_unlock(&lock);
+}
+
+uint16_t fwcfg_find_file(const char *name, uint32_t *size)
+{
+	struct fwcfg_file file;
+	uint16_t select = 0;
+	uint32_t count;
+
+	spin_lock(&lock);
+	outw(FW_CFG_FILE_DIR, BIOS_CFG_IOPORT);
+	fwcfg_read_bytes(&count, sizeof(count));
+	for (count = __builtin_bswap32(count); count; count--) {
+		fwcfg_read_bytes(&file, sizeof(file));
+		if (!strncmp(file.name, name, sizeof(file.name))) {
+			select = __builtin_bswap16(file.select);
+			*size = __builtin_bswap32(file.size);
+			break;
+		}
+	}
+	spin_unlock(&lock);
+
+	return select;
+}
@@ -20,6 +20,7 @@
 #define FW_CFG_NUMA             0x0d
 #define FW_CFG_BOOT_MENU        0x0e
 #define FW_CFG_MAX_CPUS         0x0f
+#define FW_CFG_FILE_DIR         0x19
 
 /* Dummy entries used when running on bare metal */
 #define FW_CFG_MAX_RAM		0x11
@@ -52,5 +53,14 @@ uint64_t fwcfg_get_u64(unsigned index);
 
 unsigned fwcfg_get_nb_cpus(void);
 
+/*
+ * Look up a named fw_cfg file (e.g. one given with QEMU's -fw_cfg).
+ * Returns its selector, 0 if there is no such file, and its size.
+ */
+uint16_t fwcfg_find_file(const char *name, uint32_t *size);
+
+/* Read the first len bytes of the fw_cfg item select. */
+void fwcfg_read(uint16_t select, void *buf, uint32_t len);
+
 #endif
 
@@ -12,14 +12,34 @@ static struct spinlock lock;
 static int serial_iobase = 0x3f8;
 static int serial_inited = 0;
 
-static void serial_outb(char ch)
+#define UART_FIFO_SIZE	16
+#define DEBUGCON_PORT	0xe9
+
+/*
+ * How puts() reaches the host, see setup_console().  Every port access is
+ * an exit, so the default fills the UART's transmit FIFO with one rep
+ * outsb per burst instead of polling the line status before each byte.
+ */
+enum console_mode {
+	CONSOLE_FIFO,		/* 16550 FIFO, written in FIFO-sized bursts */
+	CONSOLE_SERIAL,		/* one polled outb per character, FIFO off */
+	CONSOLE_DEBUGCON,	/* whole strings to the ISA debugcon port */
+};
+
+static enum console_mode console_mode;
+
+static void serial_wait_thre(void)
 {
         u8 lsr;
 
         do {
                 lsr = inb(serial_iobase + 0x05);
         } while (!(lsr & 0x20));
+}
 
+static void serial_outb(char ch)
+{
+        serial_wait_thre();
         outb(ch, serial_iobase + 0x00);
 }
 
@@ -53,27 +73,72 @@ static void serial_init(void)
         outb(0x00, serial_iobase + 0x01);
         /* LCR: 8 bits, no parity, one stop bit */
         outb(0x03, serial_iobase + 0x03);
-        /* FCR: disable FIFO queues */
-        outb(0x00, serial_iobase + 0x02);
+        /* FCR: enable and clear the FIFO queues, or disable them */
+        if (console_mode == CONSOLE_FIFO) {
+                outb(0x07, serial_iobase + 0x02);
+                /* IIR: both FIFO bits are only set on a working 16550A */
+                if ((inb(serial_iobase + 0x02) & 0xc0) != 0xc0)
+                        console_mode = CONSOLE_SERIAL;
+        }
+        if (console_mode != CONSOLE_FIFO)
+                outb(0x00, serial_iobase + 0x02);
         /* MCR: RTS, DTR on */
         outb(0x03, serial_iobase + 0x04);
 }
 
+/*
+ * Once THRE is set the transmit FIFO is empty and takes UART_FIFO_SIZE
+ * bytes without further polling.
+ */
+static void serial_write_fifo(const char *buf, unsigned long len)
+{
+        char burst[UART_FIFO_SIZE];
+        unsigned long i, n = 0;
+
+        for (i = 0; i < len; i++) {
+                if (n > UART_FIFO_SIZE - 2) {
+                        serial_wait_thre();
+                        outsb(burst, n, serial_iobase + 0x00);
+                        n = 0;
+                }
+                /* Force carriage return to be performed on \n */
+                if (buf[i] == '\n')
+                        burst[n++] = '\r';
+                burst[n++] = buf[i];
+        }
+
+        if (n) {
+                serial_wait_thre();
+                outsb(burst, n, serial_iobase + 0x00);
+        }
+}
+
 static void print_serial(const char *buf)
 {
 	unsigned long len = strlen(buf);
 #ifdef USE_SERIAL
         unsigned long i;
+
+        if (console_mode == CONSOLE_DEBUGCON) {
+                outsb(buf, len, DEBUGCON_PORT);
+                return;
+        }
+
         if (!serial_inited) {
             serial_init();
             serial_inited = 1;
         }
 
+        if (console_mode == CONSOLE_FIFO) {
+                serial_write_fifo(buf, len);
+                return;
+        }
+
         for (i = 0; i < len; i++) {
             serial_put(buf[i]);
         }
 #else
-        asm volatile ("rep/outsb" : "+S"(buf), "+c"(len) : "d"(0xf1));
+        outsb(buf, len, 0xf1);
 #endif
 }
 
@@ -84,6 +149,33 @@ void puts(const char *s)
 	spin_unlock(&lock);
 }
 
+/*
+ * Select the console from the CONSOLE environment variable: "fifo" (the
+ * default), "serial" for the unbuffered, polled UART, or "debugcon" for
+ * QEMU's -debugcon, which takes whole strings with a single rep outsb.
+ */
+void setup_console(void)
+{
+	const char *str = getenv("CONSOLE");
+	enum console_mode mode;
+
+	if (!str || strcmp(str, "fifo") == 0)
+		mode = CONSOLE_FIFO;
+	else if (strcmp(str, "serial") == 0)
+		mode = CONSOLE_SERIAL;
+	else if (strcmp(str, "debugcon") == 0)
+		mode = CONSOLE_DEBUGCON;
+	else {
+		printf("unknown CONSOLE=%s, using fifo\n", str);
+		return;
+	}
+
+	spin_lock(&lock);
+	console_mode = mode;
+	serial_inited = 0;
+	spin_unlock(&lock);
+}
+
 void exit(int code)
 {
 #ifdef USE_SERIAL
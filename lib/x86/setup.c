@@ -9,6 +9,7 @@
 #include "fwcfg.h"
 #include "alloc_phys.h"
 #include "argv.h"
+#include "asm/io.h"
 
 extern char edata;
 
@@ -127,6 +128,7 @@ void setup_libcflat(void)
 
 		memcpy(env, initrd, size);
 		setup_env(env, size);
+		setup_console();
 		if ((str = getenv("BOOTLOADER")) && atol(str) != 0)
 			add_setup_arg("bootloader");
 	}
@@ -6,33 +6,61 @@
 #include "apic.h"
 #include "fwcfg.h"
 #include "desc.h"
+#include "delay.h"
+#include "trace.h"
+#include "bench.h"
 
 #define IPI_VECTOR 0x20
 
 typedef void (*ipi_function_type)(void *data);
 
-static struct spinlock ipi_lock;
-static volatile ipi_function_type ipi_function;
-static void *volatile ipi_data;
-static volatile int ipi_done;
-static volatile bool ipi_wait;
+/*
+ * Every CPU has its own mailbox, indexed by APIC ID, so that requests to
+ * different CPUs can be posted and acknowledged concurrently.  The
+ * sender holds the mailbox lock from posting the request until the
+ * target acknowledges it; the function pointer is written last and
+ * cleared by the target once it has taken the request.
+ */
+struct ipi_mailbox {
+    volatile ipi_function_type function;
+    void *volatile data;
+    volatile bool wait;
+    volatile int done;
+    struct spinlock lock;
+} __attribute__((aligned(64)));
+
+static struct ipi_mailbox ipi_mailbox[MAX_TEST_CPUS];
+static u8 cpu_index[MAX_TEST_CPUS];	/* the inverse of id_map */
 static int _cpu_count;
 static atomic_t active_cpus;
 
+/*
+ * The mailbox is found by the APIC ID read from the APIC rather than by
+ * smp_id(), which is only right as long as the GS base has not been
+ * changed, e.g. by a nested guest.
+ */
 static __attribute__((used)) void ipi(void)
 {
-    void (*function)(void *data) = ipi_function;
-    void *data = ipi_data;
-    bool wait = ipi_wait;
+    struct ipi_mailbox *mbox = &ipi_mailbox[apic_id()];
+    void (*function)(void *data) = mbox->function;
+    void *data = mbox->data;
+    bool wait = mbox->wait;
+
+    /* Woken by a broadcast to other CPUs, or request already taken. */
+    if (!function) {
+	apic_write(APIC_EOI, 0);
+	return;
+    }
+    mbox->function = NULL;
 
     if (!wait) {
-	ipi_done = 1;
+	mbox->done = 1;
 	apic_write(APIC_EOI, 0);
     }
     function(data);
     atomic_dec(&active_cpus);
     if (wait) {
-	ipi_done = 1;
+	mbox->done = 1;
 	apic_write(APIC_EOI, 0);
     }
 }
@@ -52,6 +80,7 @@ int cpu_count(void)
     return _cpu_count;
 }
 
+/* The APIC ID, stored in the per-cpu area by save_id in cstart. */
 int smp_id(void)
 {
     unsigned id;
@@ -60,9 +89,35 @@ int smp_id(void)
     return id;
 }
 
-static void setup_smp_id(void *data)
+int smp_cpu_index(void)
+{
+    unsigned int id = smp_id();
+
+    assert(id < MAX_TEST_CPUS);
+    return cpu_index[id];
+}
+
+static void ipi_post(unsigned int target, void (*function)(void *data),
+		     void *data, int wait)
+{
+    struct ipi_mailbox *mbox = &ipi_mailbox[target];
+
+    spin_lock(&mbox->lock);
+    atomic_inc(&active_cpus);
+    mbox->data = data;
+    mbox->wait = wait;
+    mbox->done = 0;
+    barrier();
+    mbox->function = function;
+}
+
+static void ipi_complete(unsigned int target)
 {
-    asm ("mov %0, %%gs:0" : : "r"(apic_id()) : "memory");
+    struct ipi_mailbox *mbox = &ipi_mailbox[target];
+
+    while (!mbox->done)
+	pause();
+    spin_unlock(&mbox->lock);
 }
 
 static void __on_cpu(int cpu, void (*function)(void *data), void *data,
@@ -70,21 +125,15 @@ static void __on_cpu(int cpu, void (*function)(void *data), void *data,
 {
     unsigned int target = id_map[cpu];
 
-    spin_lock(&ipi_lock);
-    if (target == smp_id())
+    if (target == smp_id()) {
 	function(data);
-    else {
-	atomic_inc(&active_cpus);
-	ipi_done = 0;
-	ipi_function = function;
-	ipi_data = data;
-	ipi_wait = wait;
-	apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL | APIC_DM_FIXED
-                       | IPI_VECTOR, target);
-	while (!ipi_done)
-	    ;
+	return;
     }
-    spin_unlock(&ipi_lock);
+
+    ipi_post(target, function, data, wait);
+    apic_icr_write(APIC_INT_ASSERT | APIC_DEST_PHYSICAL | APIC_DM_FIXED
+                   | IPI_VECTOR, target);
+    ipi_complete(target);
 }
 
 void on_cpu(int cpu, void (*function)(void *data), void *data)
@@ -97,12 +146,34 @@ void on_cpu_async(int cpu, void (*function)(void *data), void *data)
     __on_cpu(cpu, function, data, 0);
 }
 
-void on_cpus(void (*function)(void *data), void *data)
+/*
+ * Posts @function to every other CPU and kicks them all with a single
+ * all-but-self IPI, then waits until every CPU has taken its request.
+ */
+void on_other_cpus_async(void (*function)(void *data), void *data)
 {
+    unsigned int self = smp_id();
     int cpu;
 
+    if (cpu_count() == 1)
+	return;
+
     for (cpu = cpu_count() - 1; cpu >= 0; --cpu)
-        on_cpu_async(cpu, function, data);
+	if (id_map[cpu] != self)
+	    ipi_post(id_map[cpu], function, data, 0);
+
+    apic_icr_write(APIC_INT_ASSERT | APIC_DEST_ALLBUT | APIC_DEST_PHYSICAL
+                   | APIC_DM_FIXED | IPI_VECTOR, 0);
+
+    for (cpu = cpu_count() - 1; cpu >= 0; --cpu)
+	if (id_map[cpu] != self)
+	    ipi_complete(id_map[cpu]);
+}
+
+void on_cpus(void (*function)(void *data), void *data)
+{
+    on_other_cpus_async(function, data);
+    function(data);
 
     while (cpus_active() > 1)
         pause();
@@ -113,20 +184,29 @@ int cpus_active(void)
     return atomic_read(&active_cpus);
 }
 
+static u64 read_tsc(void)
+{
+    return rdtsc();
+}
+
 void smp_init(void)
 {
-    int i;
     void ipi_entry(void);
+    int i, max_id = 0;
 
     _cpu_count = fwcfg_get_nb_cpus();
 
     setup_idt();
     init_apic_map();
-    set_idt_entry(IPI_VECTOR, ipi_entry, 0);
 
-    setup_smp_id(0);
-    for (i = 1; i < cpu_count(); ++i)
-        on_cpu(i, setup_smp_id, 0);
+    /* Trace rings are indexed by APIC ID, like smp_id() returns. */
+    for (i = 0; i < _cpu_count; i++) {
+        max_id = MAX(max_id, id_map[i]);
+        cpu_index[id_map[i]] = i;
+    }
+    trace_init(max_id + 1, smp_id, read_tsc, tsc_hz);
+    bench_smp_init(smp_cpu_index, read_tsc, tsc_hz, on_cpu_async);
+    set_idt_entry(IPI_VECTOR, ipi_entry, 0);
 
     atomic_inc(&active_cpus);
 }
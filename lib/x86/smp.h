@@ -6,10 +6,13 @@ void smp_init(void);
 
 int cpu_count(void);
 int smp_id(void);
+/* The index of the calling CPU, 0 .. cpu_count() - 1, unlike its APIC ID */
+int smp_cpu_index(void);
 int cpus_active(void);
 void on_cpu(int cpu, void (*function)(void *data), void *data);
 void on_cpu_async(int cpu, void (*function)(void *data), void *data);
 void on_cpus(void (*function)(void *data), void *data);
+void on_other_cpus_async(void (*function)(void *data), void *data);
 void smp_reset_apic(void);
 
 #endif
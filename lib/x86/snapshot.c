@@ -0,0 +1,39 @@
+/*
+ * Restart points for run_tests.sh --snapshot, see snapshot.h.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "argv.h"
+#include "fwcfg.h"
+#include "delay.h"
+#include "snapshot.h"
+
+extern int __argc;
+
+void snapshot_point(int *argc)
+{
+	static char args[1000];
+	const char *str = getenv("SNAPSHOT");
+	uint16_t select;
+	uint32_t size;
+
+	if (!str || strcmp(str, "yes"))
+		return;
+
+	printf("SNAPSHOT-READY\n");
+
+	/*
+	 * The VM is saved while polling.  Each poll reads the whole fw_cfg
+	 * directory, so do not poll more often than necessary.
+	 */
+	while (!(select = fwcfg_find_file(SNAPSHOT_ARGS_FILE, &size)))
+		delay(IPI_DELAY);
+
+	size = MIN(size, sizeof(args) - 1);
+	fwcfg_read(select, args, size);
+	args[size] = '\0';
+
+	replace_setup_args(args);
+	*argc = __argc;
+}
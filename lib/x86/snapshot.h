@@ -0,0 +1,29 @@
+/*
+ * Restart points for run_tests.sh --snapshot.
+ *
+ * Many tests in unittests.cfg boot the same kernel and only differ in the
+ * arguments they pass with -append.  With --snapshot, the runner boots
+ * each such kernel once with SNAPSHOT=yes in the environment, saves the
+ * VM state when it reaches snapshot_point(), and starts every test from
+ * that state with its arguments in the fw_cfg file SNAPSHOT_ARGS_FILE.
+ *
+ * Tests call snapshot_point() from main() after their common setup (e.g.
+ * setup_vm()) and before looking at argv, and are put in the 'snapshot'
+ * group in unittests.cfg.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#ifndef _X86_SNAPSHOT_H_
+#define _X86_SNAPSHOT_H_
+
+#define SNAPSHOT_ARGS_FILE	"opt/kvm-unit-tests/args"
+
+/*
+ * Without SNAPSHOT=yes this does nothing.  Otherwise it announces the
+ * restart point to the runner with "SNAPSHOT-READY" and waits for the
+ * arguments of the test, which replace argv[1] onwards.  argc is updated
+ * to match.
+ */
+void snapshot_point(int *argc);
+
+#endif
@@ -3,14 +3,51 @@
 #include "vmalloc.h"
 #include "alloc_page.h"
 #include "smp.h"
+#include "apic.h"
 
 static pteval_t pte_opt_mask;
 
-pteval_t *install_pte(pgd_t *cr3,
-		      int pte_level,
-		      void *virt,
-		      pteval_t pte,
-		      pteval_t *pt_page)
+void pt_pool_init(struct pt_pool *pool, unsigned long nr_tables)
+{
+	pool->nr = 0;
+	pool->batch = MAX(MIN(nr_tables, PT_POOL_SIZE), 1);
+}
+
+void *pt_pool_get(struct pt_pool *pool)
+{
+	if (!pool->nr) {
+		pool->nr = alloc_pages_bulk(0, pool->batch, pool->pages);
+		assert(pool->nr);
+	}
+	return pool->pages[--pool->nr];
+}
+
+/*
+ * Upper bound on the number of page tables needed below the root to map
+ * len bytes with PTEs at pte_level.
+ */
+static unsigned long nr_pt_tables(size_t len, int pte_level)
+{
+	unsigned long n = 0;
+	int level;
+
+	for (level = pte_level; level < PAGE_LEVEL; level++)
+		n += ((u64)len >> PGDIR_BITS(level + 1)) + 2;
+	return n;
+}
+
+void pt_pool_release(struct pt_pool *pool)
+{
+	while (pool->nr)
+		free_page(pool->pages[--pool->nr]);
+}
+
+static pteval_t *__install_pte(pgd_t *cr3,
+			       int pte_level,
+			       void *virt,
+			       pteval_t pte,
+			       pteval_t *pt_page,
+			       struct pt_pool *pool)
 {
     int level;
     pteval_t *pt = cr3;
@@ -20,11 +57,14 @@ pteval_t *install_pte(pgd_t *cr3,
 	offset = PGDIR_OFFSET((uintptr_t)virt, level);
 	if (!(pt[offset] & PT_PRESENT_MASK)) {
 	    pteval_t *new_pt = pt_page;
-            if (!new_pt)
-                new_pt = alloc_page();
-            else
+            if (new_pt) {
                 pt_page = 0;
-	    memset(new_pt, 0, PAGE_SIZE);
+                memset(new_pt, 0, PAGE_SIZE);
+            } else if (pool) {
+                new_pt = pt_pool_get(pool);
+            } else {
+                new_pt = alloc_page();
+            }
 	    pt[offset] = virt_to_phys(new_pt) | PT_PRESENT_MASK | PT_WRITABLE_MASK | pte_opt_mask;
 	}
 	pt = phys_to_virt(pt[offset] & PT_ADDR_MASK);
@@ -34,6 +74,15 @@ pteval_t *install_pte(pgd_t *cr3,
     return &pt[offset];
 }
 
+pteval_t *install_pte(pgd_t *cr3,
+		      int pte_level,
+		      void *virt,
+		      pteval_t pte,
+		      pteval_t *pt_page)
+{
+    return __install_pte(cr3, pte_level, virt, pte, pt_page, NULL);
+}
+
 /*
  * Finds last PTE in the mapping of @virt that's at or above @lowest_level. The
  * returned PTE isn't necessarily present, but its parent is.
@@ -103,7 +152,8 @@ pteval_t *install_page(pgd_t *cr3, phys_addr_t phys, void *virt)
     return install_pte(cr3, 1, virt, phys | PT_PRESENT_MASK | PT_WRITABLE_MASK | pte_opt_mask, 0);
 }
 
-void install_pages(pgd_t *cr3, phys_addr_t phys, size_t len, void *virt)
+static void __install_pages(pgd_t *cr3, phys_addr_t phys, size_t len, void *virt,
+			    struct pt_pool *pool)
 {
 	phys_addr_t max = (u64)len + (u64)phys;
 	assert(phys % PAGE_SIZE == 0);
@@ -111,12 +161,23 @@ void install_pages(pgd_t *cr3, phys_addr_t phys, size_t len, void *virt)
 	assert(len % PAGE_SIZE == 0);
 
 	while (phys + PAGE_SIZE <= max) {
-		install_page(cr3, phys, virt);
+		__install_pte(cr3, 1, virt,
+			      phys | PT_PRESENT_MASK | PT_WRITABLE_MASK | pte_opt_mask,
+			      0, pool);
 		phys += PAGE_SIZE;
 		virt = (char *) virt + PAGE_SIZE;
 	}
 }
 
+void install_pages(pgd_t *cr3, phys_addr_t phys, size_t len, void *virt)
+{
+	struct pt_pool pool;
+
+	pt_pool_init(&pool, nr_pt_tables(len, 1));
+	__install_pages(cr3, phys, len, virt, &pool);
+	pt_pool_release(&pool);
+}
+
 bool any_present_pages(pgd_t *cr3, void *virt, size_t len)
 {
 	uintptr_t max = (uintptr_t) virt + len;
@@ -132,14 +193,21 @@ bool any_present_pages(pgd_t *cr3, void *virt, size_t len)
 
 static void setup_mmu_range(pgd_t *cr3, phys_addr_t start, size_t len)
 {
+	struct pt_pool pool;
 	u64 max = (u64)len + (u64)start;
 	u64 phys = start;
 
+	/* Large pages, plus the page table for a misaligned tail */
+	pt_pool_init(&pool, nr_pt_tables(len, 2) + 1);
+
 	while (phys + LARGE_PAGE_SIZE <= max) {
-		install_large_page(cr3, phys, (void *)(ulong)phys);
+		__install_pte(cr3, 2, (void *)(ulong)phys,
+			      phys | PT_PRESENT_MASK | PT_WRITABLE_MASK |
+			      pte_opt_mask | PT_PAGE_SIZE_MASK, 0, &pool);
 		phys += LARGE_PAGE_SIZE;
 	}
-	install_pages(cr3, phys, max - phys, (void *)(ulong)phys);
+	__install_pages(cr3, phys, max - phys, (void *)(ulong)phys, &pool);
+	pt_pool_release(&pool);
 }
 
 static void set_additional_vcpu_vmregs(struct vm_vcpu_info *info)
@@ -153,7 +221,7 @@ void *setup_mmu(phys_addr_t end_of_memory, void *opt_mask)
 {
     pgd_t *cr3 = alloc_page();
     struct vm_vcpu_info info;
-    int i;
+    int i, max_id = 0;
 
     if (opt_mask)
 	pte_opt_mask = *(pteval_t *)opt_mask;
@@ -191,6 +259,11 @@ void *setup_mmu(phys_addr_t end_of_memory, void *opt_mask)
     for (i = 1; i < cpu_count(); i++)
         on_cpu(i, (void *)set_additional_vcpu_vmregs, &info);
 
+    /* smp_id() returns the APIC ID, so size the caches by the largest. */
+    for (i = 0; i < cpu_count(); i++)
+        max_id = MAX(max_id, id_map[i]);
+    page_alloc_cpu_caches_enable(max_id + 1, smp_id);
+
     return cr3;
 }
 
@@ -34,6 +34,24 @@ pteval_t *install_pte(pgd_t *cr3,
 		      pteval_t pte,
 		      pteval_t *pt_page);
 
+/*
+ * Zeroed page-table pages for building large mappings, allocated in
+ * batches with alloc_pages_bulk() instead of one by one.  The batch size
+ * is the expected number of tables, capped at PT_POOL_SIZE;
+ * pt_pool_release() frees the pages that were not used.
+ */
+#define PT_POOL_SIZE	64
+
+struct pt_pool {
+	unsigned int nr;
+	unsigned int batch;
+	void *pages[PT_POOL_SIZE];
+};
+
+void pt_pool_init(struct pt_pool *pool, unsigned long nr_tables);
+void *pt_pool_get(struct pt_pool *pool);
+void pt_pool_release(struct pt_pool *pool);
+
 pteval_t *install_large_page(pgd_t *cr3, phys_addr_t phys, void *virt);
 void install_pages(pgd_t *cr3, phys_addr_t phys, size_t len, void *virt);
 bool any_present_pages(pgd_t *cr3, void *virt, size_t len);
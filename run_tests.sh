@@ -3,6 +3,11 @@
 verbose="no"
 tap_output="no"
 run_all_tests="no" # don't run nodefault tests
+bench="no"
+bench_baseline="bench-baseline"
+snapshot="no"
+batch="no"
+junit_file=""
 
 if [ ! -f config.mak ]; then
     echo "run ./configure && make first. See ./configure -h"
@@ -10,20 +15,51 @@ if [ ! -f config.mak ]; then
 fi
 source config.mak
 source scripts/common.bash
+source scripts/shard.bash
 
 function usage()
 {
 cat <<EOF
 
-Usage: $0 [-h] [-v] [-a] [-g group] [-j NUM-TASKS] [-t]
+Usage: $0 [-h] [-v] [-a] [-g group] [-j NUM-TASKS] [-t] [--bench]
+          [--bench-baseline FILE] [--cpus NUM] [--mem MB]
+          [--shard INDEX/COUNT [--shard-durations FILE]] [--snapshot]
+          [--batch] [--junit FILE]
 
     -h, --help      Output this help text
     -v, --verbose   Enables verbose mode
     -a, --all       Run all tests, including those flagged as 'nodefault'
                     and those guarded by errata.
     -g, --group     Only execute tests in the given group
-    -j, --parallel  Execute tests in parallel
+    -j, --parallel  Execute tests in parallel, at most NUM-TASKS at a time.
+                    Tests are started longest first, by the durations of
+                    earlier runs, then largest first, and only while their
+                    vCPUs and memory fit into the --cpus and --mem budgets
     -t, --tap13     Output test results in TAP format
+    --bench         Run the tests in the 'bench' group and compare their
+                    results against a baseline, failing on regressions
+    --bench-baseline
+                    Baseline file for --bench (default: bench-baseline),
+                    created from the current results if it does not exist
+    --cpus          vCPUs that parallel tests may use in total
+                    (default: the number of host CPUs)
+    --mem           Memory in MB that parallel tests may use in total
+                    (default: the host's available memory)
+    --shard         Only run the INDEX-th (from 1) of COUNT disjoint shards
+                    of the selected tests, see scripts/shard.bash.  Combine
+                    the logs of all shards with scripts/merge_shards.py
+    --shard-durations
+                    Durations file ("<test> <ms>" lines) to balance the
+                    shards with; every shard must be given the same file
+    --snapshot      Boot the kernel of the tests in the 'snapshot' group
+                    once per QEMU configuration shared by two or more of
+                    them and restart each of those tests from a saved VM
+                    state, see lib/x86/snapshot.h
+    --batch         Run the tests in the 'batch' group that only differ in
+                    the test cases they select in one boot per kernel and
+                    QEMU configuration, rerunning failed tests on their own
+    --junit         Also write the results as JUnit XML to FILE, with the
+                    wall time of each test and of each of its reports
 
 Set the environment variable QEMU=/path/to/qemu-system-ARCH to
 specify the appropriate qemu binary for ARCH-run.
@@ -31,6 +67,14 @@ specify the appropriate qemu binary for ARCH-run.
 EOF
 }
 
+# Cache QEMU probes for the whole run, see qemu_probe in arch-run.bash
+if [ ! -d "$KVM_UNIT_TESTS_PROBE_CACHE" ]; then
+    KVM_UNIT_TESTS_PROBE_CACHE=$(mktemp -d -t kvm-unit-tests-probes.XXXXXXXXXX)
+    trap 'rm -rf "$KVM_UNIT_TESTS_PROBE_CACHE"' EXIT
+fi
+export KVM_UNIT_TESTS_PROBE_CACHE
+source scripts/arch-run.bash
+
 RUNTIME_arch_run="./$TEST_DIR/run"
 source scripts/runtime.bash
 
@@ -42,7 +86,7 @@ if [ $? -ne 4 ]; then
 fi
 
 only_tests=""
-args=$(getopt -u -o ag:htj:v -l all,group:,help,tap13,parallel:,verbose -- $*)
+args=$(getopt -u -o ag:htj:v -l all,group:,help,tap13,parallel:,verbose,bench,bench-baseline:,cpus:,mem:,shard:,shard-durations:,snapshot,batch,junit: -- $*)
 [ $? -ne 0 ] && exit 2;
 set -- $args;
 while [ $# -gt 0 ]; do
@@ -73,6 +117,56 @@ while [ $# -gt 0 ]; do
         -t | --tap13)
             tap_output="yes"
             ;;
+        --bench)
+            bench="yes"
+            only_group="bench"
+            export BENCH_FORMAT=json
+            ;;
+        --bench-baseline)
+            shift
+            bench_baseline=$1
+            ;;
+        --cpus)
+            shift
+            unittest_cpus=$1
+            if (( $unittest_cpus <= 0 )); then
+                echo "Invalid --cpus option: $unittest_cpus"
+                exit 2
+            fi
+            ;;
+        --mem)
+            shift
+            unittest_mem=$1
+            if (( $unittest_mem <= 0 )); then
+                echo "Invalid --mem option: $unittest_mem"
+                exit 2
+            fi
+            ;;
+        --shard)
+            shift
+            shard=$(parse_shard "$1") || exit 2
+            shard_name=$1
+            ;;
+        --shard-durations)
+            shift
+            shard_durations=$1
+            if [ ! -f "$shard_durations" ]; then
+                echo "$shard_durations not found"
+                exit 2
+            fi
+            ;;
+        --snapshot)
+            snapshot="yes"
+            ;;
+        --batch)
+            batch="yes"
+            ;;
+        --junit)
+            shift
+            junit_file=$1
+            # time the reports, see lib/report.c
+            export REPORT_TIMING=yes
+            ;;
         --)
             ;;
         *)
@@ -82,32 +176,19 @@ while [ $# -gt 0 ]; do
     shift
 done
 
-# RUNTIME_log_file will be configured later
+# The saved VM states only live as long as the run, see run_snapshot in
+# arch-run.bash
+if [ "$snapshot" = "yes" ]; then
+    KVM_UNIT_TESTS_SNAPSHOT_DIR=$(mktemp -d -t kvm-unit-tests-snapshots.XXXXXXXXXX)
+    trap_exit_push 'rm -rf "$KVM_UNIT_TESTS_SNAPSHOT_DIR"'
+    export KVM_UNIT_TESTS_SNAPSHOT_DIR
+fi
+
+# RUNTIME_log_file will be configured later, see log_output in runtime.bash
+RUNTIME_log_tap=$tap_output
 if [[ $tap_output == "no" ]]; then
-    process_test_output() { cat >> $RUNTIME_log_file; }
     postprocess_suite_output() { cat; }
 else
-    process_test_output() {
-        local testname="$1"
-        CR=$'\r'
-        while read -r line; do
-            line="${line%$CR}"
-            case "${line:0:4}" in
-                PASS)
-                    echo "ok TEST_NUMBER - ${testname}: ${line#??????}" >&3
-                    ;;
-                FAIL)
-                    echo "not ok TEST_NUMBER - ${testname}: ${line#??????}" >&3
-                    ;;
-                SKIP)
-                    echo "ok TEST_NUMBER - ${testname}: ${line#??????} # skip" >&3
-                    ;;
-                *)
-                    ;;
-            esac
-            echo "${line}"
-        done >> $RUNTIME_log_file
-    }
     postprocess_suite_output() {
         test_number=0
         while read -r line; do
@@ -122,36 +203,520 @@ else
     }
 fi
 
-RUNTIME_log_stderr () { process_test_output "$1"; }
-RUNTIME_log_stdout () {
-    local testname="$1"
-    if [ "$PRETTY_PRINT_STACKS" = "yes" ]; then
-        local kernel="$2"
-        ./scripts/pretty_print_stacks.py "$kernel" | process_test_output "$testname"
-    else
-        process_test_output "$testname"
-    fi
+RUNTIME_log_duration () { echo "$1 $2" >> $unittest_log_dir/durations.new; }
+RUNTIME_log_result () { echo "$1 $2 ${4:+($4)}$3" >> $unittest_log_dir/results; }
+
+#
+# With --shard, the tests that pass the name and group filters are split
+# up first and the others are left out of this run like filtered tests.
+#
+shard_candidates=()
+shard_selected=""
+
+function shard_candidate()
+{
+	local testname="$1" groups="$2"
+
+	if [ -n "$only_tests" ] && ! find_word "$testname" "$only_tests"; then
+		return
+	fi
+	if [ -n "$only_group" ] && ! find_word "$only_group" "$groups"; then
+		return
+	fi
+	shard_candidates+=("$testname")
+}
+
+# s390x's _PV variants go with their base test
+function in_shard()
+{
+	[ -z "$shard" ] || find_word "${1%_PV}" "$shard_selected"
 }
 
 function run_task()
 {
 	local testname="$1"
 
-	while (( $(jobs | wc -l) == $unittest_run_queues )); do
-		# wait for any background test to finish
-		wait -n 2>/dev/null
+	in_shard "$testname" || return
+	find_word "$testname" "$batched_tests" && return
+	RUNTIME_log_file="${unittest_log_dir}/${testname}.log"
+	run "$@"
+}
+
+# QEMU's default guest memory, for tests without -m, in MB
+default_test_mem=128
+
+function test_cpus()
+{
+	local smp="$1"
+
+	# smp may refer to $MAX_SMP and carry topology options after a comma
+	smp=$(eval echo "$smp")
+	smp=${smp%%,*}
+	smp=${smp#cpus=}
+	[[ "$smp" =~ ^[0-9]+$ ]] && (( smp > 0 )) || smp=1
+	echo $smp
+}
+
+function test_mem()
+{
+	local opts="$1"
+	local mem=$default_test_mem
+
+	# the last -m wins, as in QEMU
+	while [[ "$opts" =~ (^|[[:space:]])-m[[:space:]]+([0-9]+)([kKmMgGtT]?)(.*) ]]; do
+		case "${BASH_REMATCH[3]}" in
+			k|K) mem=$(( BASH_REMATCH[2] / 1024 )) ;;
+			g|G) mem=$(( BASH_REMATCH[2] * 1024 )) ;;
+			t|T) mem=$(( BASH_REMATCH[2] * 1024 * 1024 )) ;;
+			*) mem=${BASH_REMATCH[2]} ;;
+		esac
+		opts="${BASH_REMATCH[4]}"
 	done
+	echo $mem
+}
 
-	RUNTIME_log_file="${unittest_log_dir}/${testname}.log"
-	if [ $unittest_run_queues = 1 ]; then
-		run "$@"
+#
+# Durations are kept in $unittest_log_dir/durations, one "<test> <ms>"
+# line per test.  Each run starts from the file of the previous run and
+# updates the tests it ran, so filtered runs do not lose the others.
+#
+declare -A test_duration
+
+function read_durations()
+{
+	local file="$1" test ms
+
+	[ -f "$file" ] || return
+	while read -r test ms; do
+		[[ "$ms" =~ ^[0-9]+$ ]] && test_duration[$test]=$ms
+	done < "$file"
+}
+
+function write_durations()
+{
+	local test
+
+	read_durations $unittest_log_dir/durations.new
+	rm -f $unittest_log_dir/durations.new
+	for test in "${!test_duration[@]}"; do
+		echo "$test ${test_duration[$test]}"
+	done | sort > $unittest_log_dir/durations
+}
+
+function host_mem()
+{
+	local avail
+
+	avail=$(awk '/^MemAvailable:/ { print int($2 / 1024) }' /proc/meminfo 2>/dev/null)
+	echo ${avail:-$((1 << 30))}
+}
+
+#
+# Parallel runs queue all tests with queue_task() first, then
+# schedule_tasks() starts them as long as their vCPUs and memory fit into
+# what is left of the budgets.  A test that is larger than a budget runs
+# once nothing else does.
+#
+# Tests are started longest first, so that the long ones do not end up
+# as the tail of the run, by their durations in milliseconds from earlier
+# runs (see read_durations()).  Tests without a recorded duration count as
+# the average one, ties are broken by starting the largest test first.
+#
+queued_args=()
+queued_cpus=()
+queued_mem=()
+
+function queue_task()
+{
+	local args
+
+	in_shard "$1" || return
+	find_word "$1" "$batched_tests" && return
+	printf -v args '%q ' "$@"
+	queued_args+=("$args")
+	queued_cpus+=($(test_cpus "$3"))
+	queued_mem+=($(test_mem "$5"))
+}
+
+function start_task()
+{
+	local i=$1
+
+	eval "set -- ${queued_args[$i]}"
+	if [ "$1" = "run_batch" ]; then
+		shift
+		run_batch "$@" &
 	else
+		RUNTIME_log_file="${unittest_log_dir}/${1}.log"
 		run "$@" &
 	fi
+	running_pids+=($!)
+	running_tasks+=($i)
+	free_cpus=$(( free_cpus - queued_cpus[i] ))
+	free_mem=$(( free_mem - queued_mem[i] ))
+}
+
+function reap_tasks()
+{
+	local k i pids=() tasks=()
+
+	for k in "${!running_pids[@]}"; do
+		i=${running_tasks[$k]}
+		if kill -0 ${running_pids[$k]} 2>/dev/null; then
+			pids+=(${running_pids[$k]})
+			tasks+=($i)
+		else
+			free_cpus=$(( free_cpus + queued_cpus[i] ))
+			free_mem=$(( free_mem + queued_mem[i] ))
+		fi
+	done
+	running_pids=("${pids[@]}")
+	running_tasks=("${tasks[@]}")
+}
+
+# task_ms AVERAGE ARGS...: expected duration of a queued task
+function task_ms()
+{
+	local total=$1 ms=0 member
+
+	shift
+	if [ "$1" != "run_batch" ]; then
+		echo ${test_duration[$1]:-$total}
+		return
+	fi
+
+	shift
+	for member in "$@"; do
+		eval "set -- $member"
+		(( ms += ${test_duration[$1]:-$total} ))
+	done
+	echo $ms
+}
+
+function schedule_tasks()
+{
+	local free_cpus=$unittest_cpus free_mem=$unittest_mem
+	local running_pids=() running_tasks=() pending=() left
+	local i started test ms total=0 known=0
+
+	for test in "${!test_duration[@]}"; do
+		(( total += test_duration[$test], known++ ))
+	done
+	(( known )) && (( total /= known ))
+
+	# longest first, then largest first: by vCPUs, then memory
+	pending=($(for i in "${!queued_args[@]}"; do
+			eval "set -- ${queued_args[$i]}"
+			ms=$(task_ms $total "$@")
+			echo "$ms ${queued_cpus[$i]} ${queued_mem[$i]} $i"
+		   done | sort -s -k1,1nr -k2,2nr -k3,3nr | cut -d' ' -f4))
+
+	while (( ${#pending[@]} )); do
+		left=()
+		started=
+		for i in "${pending[@]}"; do
+			if (( ${#running_pids[@]} < unittest_run_queues )) &&
+			   { (( ${#running_pids[@]} == 0 )) ||
+			     (( queued_cpus[i] <= free_cpus && queued_mem[i] <= free_mem )); }; then
+				start_task $i
+				started=y
+			else
+				left+=($i)
+			fi
+		done
+		pending=("${left[@]}")
+
+		if [ -z "$started" ]; then
+			# wait for any background test to finish
+			wait -n 2>/dev/null
+			reap_tasks
+		fi
+	done
+	wait
+}
+
+#
+# With --batch, the tests in the 'batch' group that boot the same kernel
+# with the same QEMU options, and only differ in the test cases they select
+# with -append, run in one boot.  The guest gets their -append arguments
+# separated by "---" and frames the output of each with BATCH-BEGIN and
+# BATCH-END lines, see report_batch_next() in lib/report.c.
+#
+# Tests whose test cases failed, or whose results cannot be told apart
+# (the guest died before their BATCH-END, or failures were reported
+# outside of any test's lines), are rerun on their own, so failures are
+# always reported from an isolated run.  Only tests whose arguments all
+# select test cases are batched: a "-name" filter would also drop the
+# test cases of the other tests.
+#
+declare -A batch_members
+batch_tasks=()
+batched_tests=""
+
+# test_selected TESTNAME GROUPS SMP KERNEL OPTS ARCH CHECK ACCEL: whether
+# the command line selects the test and run() would not skip it for its
+# architecture or accelerator
+function test_selected()
+{
+	local testname="$1" groups="$2" arch="$6" accel="$8"
+
+	in_shard "$testname" || return
+	if [ -n "$only_tests" ] && ! find_word "$testname" "$only_tests"; then
+		return 1
+	fi
+	if [ -n "$only_group" ] && ! find_word "$only_group" "$groups"; then
+		return 1
+	fi
+	if [ -z "$only_group" ] && find_word nodefault "$groups" &&
+	   [ "$run_all_tests" != "yes" ]; then
+		return 1
+	fi
+	[ -n "$arch" ] && [ "$arch" != "$ARCH" ] && return 1
+	[ -n "$accel" ] && [ -n "$ACCEL" ] && [ "$accel" != "$ACCEL" ] && return 1
+	return 0
+}
+
+# split_append OPTS: sets batch_opts to OPTS without -append and its
+# argument, which goes to batch_append
+function split_append()
+{
+	local - i
+	local -a words rest=()
+
+	set -f
+	eval "words=($1)" 2>/dev/null || return 1
+	batch_append=""
+	for (( i = 0; i < ${#words[@]}; i++ )); do
+		if [ "${words[i]}" = "-append" ]; then
+			batch_append=${words[++i]}
+		else
+			rest+=("${words[i]}")
+		fi
+	done
+	batch_opts=$(printf '%q ' "${rest[@]}")
+}
+
+function batch_candidate()
+{
+	local testname="$1" groups="$2" smp="$3" kernel="$4" opts="$5"
+	local arch="$6" check="${CHECK:-$7}" accel="$8"
+	local - args word
+
+	find_word batch "$groups" || return
+	test_selected "$@" || return
+
+	# skips, checks and migration are left to run()
+	[ -n "$check" ] && return
+	find_word migration "$groups" && return
+
+	# only plain options, their expansion is left to run() as well
+	[[ "$opts" == *[\`\$]* ]] && return
+	split_append "$opts" || return
+	[ -n "$batch_append" ] || return
+	set -f
+	for word in $batch_append; do
+		[[ "$word" == -* ]] && return
+	done
+
+	printf -v args '%q ' "$@"
+	batch_members["$kernel $smp ${ACCEL:-$accel} $batch_opts"]+="$args"$'\n'
+}
+
+# Only groups of two or more tests are worth a batch
+function batch_setup()
+{
+	local key member
+	local -a keys members
+
+	mapfile -t keys < <(printf '%s\n' "${!batch_members[@]}" | sort)
+	for key in "${keys[@]}"; do
+		[ -n "$key" ] || continue
+		mapfile -t members <<<"${batch_members[$key]%$'\n'}"
+		(( ${#members[@]} > 1 )) || continue
+		for member in "${members[@]}"; do
+			eval "set -- $member"
+			batched_tests+=" $1"
+		done
+		batch_tasks+=("$(printf '%q ' "${members[@]}")")
+	done
+	batched_tests+=" "
+}
+
+#
+# --snapshot: saving a VM state costs a boot and a migration on top of
+# the test's own run, which only pays off when two or more tests restart
+# from it.  The selected tests of the 'snapshot' group that run on their
+# own are counted by QEMU configuration (kernel, smp, accelerator and
+# options less -append, as in run_snapshot in arch-run.bash), and only
+# those that share one are listed in snapshot_tests for run() to start
+# from a snapshot; the others boot as usual.
+#
+declare -A snapshot_members
+snapshot_tests=""
+
+function snapshot_candidate()
+{
+	local testname="$1" groups="$2" smp="$3" kernel="$4" opts="$5"
+	local accel="$8"
+
+	find_word snapshot "$groups" || return
+	test_selected "$@" || return
+	find_word "$testname" "$batched_tests" && return
+	find_word migration "$groups" && return
+
+	# options expanded by run() may differ from one test to the next
+	[[ "$opts" == *[\`\$]* ]] && return
+	split_append "$opts" || return
+	snapshot_members["$kernel $smp ${ACCEL:-$accel} $batch_opts"]+=" $testname"
+}
+
+function snapshot_setup()
+{
+	local key
+	local -a names
+
+	for key in "${!snapshot_members[@]}"; do
+		names=(${snapshot_members[$key]})
+		(( ${#names[@]} > 1 )) && snapshot_tests+="${snapshot_members[$key]}"
+	done
+	snapshot_tests+=" "
+}
+
+function queue_batch()
+{
+	# the members, then the first member's arguments for its size
+	eval "set -- $1"
+	queued_args+=("run_batch $(printf '%q ' "$@")")
+	eval "set -- $1"
+	queued_cpus+=($(test_cpus "$3"))
+	queued_mem+=($(test_mem "$5"))
+}
+
+function timeout_seconds()
+{
+	local n
+
+	if ! [[ "$1" =~ ^([0-9]+)([smhd]?)$ ]]; then
+		echo 90
+		return
+	fi
+	n=${BASH_REMATCH[1]}
+	case "${BASH_REMATCH[2]}" in
+		m) n=$(( n * 60 )) ;;
+		h) n=$(( n * 3600 )) ;;
+		d) n=$(( n * 86400 )) ;;
+	esac
+	echo $n
+}
+
+# batch_stamp STAMPS N: when the guest printed the BATCH-END line of the
+# Nth test, in milliseconds, from the STAMPS file written by run_batch()
+function batch_stamp()
+{
+	awk -v n="$2" '$2 == "BATCH-END:" && $3 == n { print $1; exit }' "$1"
+}
+
+# run_batch MEMBER...: each MEMBER holds the quoted arguments of run()
+#
+# The output streams into the batch's log as it comes, and the host's
+# time of each BATCH-BEGIN and BATCH-END line goes to a stamps file.  A
+# test that passes in the batch is charged with the time from the end of
+# the previous test, or from the start of the batch for the first one,
+# to its own BATCH-END, so that the durations add up to the batch's.
+function run_batch()
+{
+	local -a members=("$@") names=() appends=()
+	local testname groups smp kernel opts arch check accel timeout=0
+	local member append cmdline batch_log stamps seg end name i n
+	local rerun_all= unlimited= start_ms prev_ms end_ms
+
+	for member in "${members[@]}"; do
+		eval "set -- $member"
+		split_append "$5"
+		names+=("$1")
+		appends+=("$batch_append")
+		n=$(timeout_seconds "${9:-$TIMEOUT}")
+		(( n == 0 )) && unlimited=y
+		(( timeout += n ))
+	done
+	# one test without a timeout lifts it for the whole batch
+	[ "$unlimited" ] && timeout=0 || timeout=${timeout}s
+
+	eval "set -- ${members[0]}"
+	testname=$1 groups=$2 smp=$3 kernel=$4 accel=${ACCEL:-$8}
+	split_append "$5"
+	append="${appends[0]}"
+	for (( i = 1; i < ${#appends[@]}; i++ )); do
+		append+=" --- ${appends[i]}"
+	done
+	opts="$batch_opts -append $(printf '%q' "$append")"
+
+	cmdline=$(get_cmdline $kernel)
+	if [ "$verbose" = "yes" ]; then
+		echo $cmdline
+	fi
+
+	batch_log="${unittest_log_dir}/batch-${names[0]}.log"
+	stamps=$(mktemp -t kvm-unit-tests-batch.XXXXXXXXXX)
+	echo "$cmdline" > $batch_log
+	start_ms=$(date +%s%3N)
+	eval $cmdline 2>&1 |
+		awk -v stamps="$stamps" '
+			{ sub(/\r$/, "") }
+			/^BATCH-(BEGIN|END): / {
+				cmd = "date +%s%3N"
+				cmd | getline ms
+				close(cmd)
+				print ms, $1, $2 >> stamps
+				fflush(stamps)
+			}
+			{ print; fflush() }' |
+		RUNTIME_log_file=$batch_log RUNTIME_log_tap=no log_output batch > /dev/null
+
+	# failures outside of the tests' lines cannot be attributed
+	if awk -v b="BATCH-BEGIN: 1" -v e="BATCH-END: ${#members[@]} " \
+		'$0 == b { p = 1 } !p && /^FAIL/ { f = 1 } index($0, e) == 1 { p = 0 }
+		 END { exit !f }' $batch_log; then
+		rerun_all=y
+	fi
+
+	prev_ms=$start_ms
+	for i in "${!members[@]}"; do
+		name=${names[i]}
+		RUNTIME_log_file="${unittest_log_dir}/${name}.log"
+
+		seg=$(awk -v b="BATCH-BEGIN: $((i + 1))" -v e="BATCH-END: $((i + 1)) " \
+			'$0 == b { p = 1 } p { print } p && index($0, e) == 1 { exit }' $batch_log)
+		end=$(tail -1 <<<"$seg")
+		end_ms=$(batch_stamp $stamps $((i + 1)))
+
+		if [ -z "$rerun_all" ] &&
+		   [[ "$end" =~ ^BATCH-END:\ [0-9]+\ SUMMARY:\ ([0-9]+)\ tests ]] &&
+		   (( BASH_REMATCH[1] > 0 )) && [[ "$end" != *"unexpected failures"* ]]; then
+			n=${BASH_REMATCH[1]}
+			{
+				echo "$cmdline"
+				echo "(batched with ${names[*]}, see $batch_log)"
+				echo "$seg"
+			} | log_output $name > /dev/null
+			[ "$end_ms" ] && RUNTIME_log_duration $name $(( end_ms - prev_ms ))
+			if [[ "$end" =~ ,\ $n\ skipped ]]; then
+				print_result "SKIP" $name "(${end#*SUMMARY: })"
+			else
+				print_result "PASS" $name "(${end#*SUMMARY: })"
+			fi
+		else
+			eval "run ${members[i]}"
+		fi
+		[ "$end_ms" ] && prev_ms=$end_ms
+	done
+	rm -f $stamps
 }
 
 : ${unittest_log_dir:=logs}
 : ${unittest_run_queues:=1}
+: ${unittest_cpus:=$(getconf _NPROCESSORS_ONLN)}
+: ${unittest_mem:=$(host_mem)}
 config=$TEST_DIR/unittests.cfg
 
 rm -rf $unittest_log_dir.old
@@ -159,6 +724,20 @@ rm -rf $unittest_log_dir.old
 mkdir $unittest_log_dir || exit 2
 
 echo "BUILD_HEAD=$(cat build-head)" > $unittest_log_dir/SUMMARY
+if [ "$shard" ]; then
+    echo "SHARD=$shard_name" >> $unittest_log_dir/SUMMARY
+    ARCH_CMD= for_each_unittest $config shard_candidate
+    shard_selected=" $(shard_tests $shard "$shard_durations" "${shard_candidates[@]}" | tr '\n' ' ') "
+fi
+read_durations $unittest_log_dir.old/durations
+if [ "$batch" = "yes" ]; then
+    ARCH_CMD= for_each_unittest $config batch_candidate
+    batch_setup
+fi
+if [ "$snapshot" = "yes" ]; then
+    ARCH_CMD= for_each_unittest $config snapshot_candidate
+    snapshot_setup
+fi
 
 if [[ $tap_output == "yes" ]]; then
     echo "TAP version 13"
@@ -167,11 +746,31 @@ fi
 trap "wait; exit 130" SIGINT
 
 (
-   # preserve stdout so that process_test_output output can write TAP to it
+   # preserve stdout so that log_output can write TAP to it
    exec 3>&1
    test "$tap_output" == "yes" && exec > /dev/null
-   for_each_unittest $config run_task
+   if [ $unittest_run_queues = 1 ]; then
+       for_each_unittest $config run_task
+       for task in "${batch_tasks[@]}"; do
+           eval "run_batch $task"
+       done
+   else
+       for_each_unittest $config queue_task
+       for task in "${batch_tasks[@]}"; do
+           queue_batch "$task"
+       done
+       schedule_tasks
+   fi
 ) | postprocess_suite_output
 
 # wait until all tasks finish
 wait
+if [ "$junit_file" ]; then
+    ./scripts/junit_xml.py -n "kvm-unit-tests $ARCH" -o "$junit_file" $unittest_log_dir
+fi
+write_durations
+
+if [ "$bench" = "yes" ]; then
+    echo
+    ./scripts/bench_compare.py "$bench_baseline" $unittest_log_dir
+fi
@@ -171,6 +171,151 @@ migration_cmd ()
 	fi
 }
 
+#
+# run_snapshot starts a test from a VM state saved at the test's
+# snapshot_point() (see lib/x86/snapshot.h), passing it its -append
+# arguments in a fw_cfg file instead.  The state is saved by a first boot
+# with SNAPSHOT=yes, once per QEMU command line (less -append and -initrd)
+# and kernel, in $KVM_UNIT_TESTS_SNAPSHOT_DIR, which run_tests.sh
+# --snapshot sets up for the whole run, for the tests whose command line
+# another test shares (see snapshot_setup in run_tests.sh).  If the state
+# cannot be saved, e.g. because the test never reaches a snapshot_point(),
+# the test is booted as usual.
+#
+snapshot_save ()
+{
+	local snap=$1 pid status ret=1
+	local qmpsock=$snap.qmp log=$snap.log
+
+	shift
+	"$@" -chardev socket,id=snapmon,path=$qmpsock,server=on,wait=off \
+		-mon chardev=snapmon,mode=control </dev/null >$log 2>&1 &
+	pid=$!
+
+	while ! grep -q "SNAPSHOT-READY" $log; do
+		if ! kill -0 $pid 2>/dev/null; then
+			wait $pid
+			return 1
+		fi
+		sleep 0.1
+	done
+
+	qmp $qmpsock '"migrate", "arguments": { "uri": "exec:cat > '$snap.tmp'" }' >/dev/null
+	while kill -0 $pid 2>/dev/null; do
+		status=$(qmp $qmpsock '"query-migrate"' | grep return)
+		if grep -q '"completed"' <<<"$status"; then
+			ret=0
+			break
+		elif grep -q '"failed"' <<<"$status"; then
+			break
+		fi
+		sleep 0.1
+	done
+	qmp $qmpsock '"quit"' >/dev/null 2>&1
+	wait $pid
+
+	[ $ret -eq 0 ] && mv -f $snap.tmp $snap
+	rm -f $snap.tmp $qmpsock
+	return $ret
+}
+
+run_snapshot ()
+{
+	local -a orig=("$@") prefix cmd key_args
+	local append= kernel= snap
+
+	if [ ! -d "$KVM_UNIT_TESTS_SNAPSHOT_DIR" ] ||
+	   ! command -v ncat >/dev/null 2>&1 || ! command -v flock >/dev/null 2>&1; then
+		"$@"
+		return
+	fi
+
+	# the timeout_cmd prefix only applies to the commands
+	if [ "$1" = "timeout" ]; then
+		prefix=("${@:1:5}")
+		shift 5
+	fi
+	while [ $# -gt 0 ]; do
+		case "$1" in
+		-append)
+			append=$2
+			shift
+			;;
+		-initrd)
+			cmd+=("$1" "$2")
+			shift
+			;;
+		-kernel)
+			kernel=$2
+			cmd+=("$1")
+			key_args+=("$1")
+			;;
+		*)
+			cmd+=("$1")
+			key_args+=("$1")
+			;;
+		esac
+		shift
+	done
+
+	snap=$KVM_UNIT_TESTS_SNAPSHOT_DIR/$(echo "${key_args[*]} $(stat -c %Y "$kernel" 2>/dev/null)" |
+					    md5sum | cut -d' ' -f1)
+
+	# parallel tests sharing a snapshot wait for the first one to save it
+	(
+		flock 9
+		[ -f $snap ] || [ -f $snap.failed ] ||
+			snapshot_save $snap "${prefix[@]}" "${cmd[@]}" ||
+			touch $snap.failed
+	) 9>$snap.lock
+
+	if [ ! -f $snap ]; then
+		"${orig[@]}"
+		return
+	fi
+
+	# commas are escaped by doubling them in QEMU options
+	"${prefix[@]}" "${cmd[@]}" -fw_cfg "name=opt/kvm-unit-tests/args,string= ${append//,/,,}" \
+		-incoming "exec:cat $snap"
+}
+
+snapshot_cmd ()
+{
+	if [ "$SNAPSHOT" = "yes" ]; then
+		echo "run_snapshot"
+	fi
+}
+
+#
+# The output of QEMU probes (help texts, device lists, dry runs) only
+# depends on the command, the QEMU binary and the accelerator.  When
+# KVM_UNIT_TESTS_PROBE_CACHE is a directory, as run_tests.sh sets it up
+# for the whole run, qemu_probe runs each distinct probe only once and
+# replays its output (stdout and stderr, merged) afterwards.  The cache
+# key includes the path and mtime of the probed binary and $ACCEL.
+#
+qemu_probe ()
+{
+	local path key file
+
+	if [ ! -d "$KVM_UNIT_TESTS_PROBE_CACHE" ]; then
+		"$@" 2>&1
+		return
+	fi
+
+	path=$(command -v "$1")
+	key=$(echo "$path $(stat -c %Y "$path" 2>/dev/null) $ACCEL $*" |
+	      md5sum | cut -d' ' -f1)
+	file=$KVM_UNIT_TESTS_PROBE_CACHE/$key
+
+	# parallel tests may probe concurrently, publish the result atomically
+	if [ ! -f "$file" ]; then
+		"$@" > "$file.$$" 2>&1
+		mv -f "$file.$$" "$file"
+	fi
+	cat "$file"
+}
+
 search_qemu_binary ()
 {
 	local save_path=$PATH
@@ -178,7 +323,7 @@ search_qemu_binary ()
 
 	export PATH=$PATH:/usr/libexec
 	for qemucmd in ${QEMU:-qemu-system-$ARCH_NAME qemu-kvm}; do
-		if $qemucmd --help 2>/dev/null | grep -q 'QEMU'; then
+		if qemu_probe $qemucmd --help | grep -q 'QEMU'; then
 			qemu="$qemucmd"
 			break
 		fi
@@ -235,7 +380,7 @@ env_params ()
 		if [ -n "$ACCEL" ] || [ -n "$QEMU_ACCEL" ]; then
 			[ -n "$ACCEL" ] && QEMU_ACCEL=$ACCEL
 		fi
-		QEMU_VERSION_STRING="$($qemu -h | head -1)"
+		QEMU_VERSION_STRING="$(qemu_probe $qemu -h | head -1)"
 		IFS='[ .]' read -r _ _ _ QEMU_MAJOR QEMU_MINOR QEMU_MICRO rest <<<"$QEMU_VERSION_STRING"
 	fi
 	env_add_params QEMU_ACCEL QEMU_VERSION_STRING QEMU_MAJOR QEMU_MINOR QEMU_MICRO
@@ -248,6 +393,13 @@ env_params ()
 	! [[ $KERNEL_SUBLEVEL =~ ^[0-9]+$ ]] && unset $KERNEL_SUBLEVEL
 	! [[ $KERNEL_EXTRAVERSION =~ ^[0-9]+$ ]] && unset $KERNEL_EXTRAVERSION
 	env_add_params KERNEL_VERSION_STRING KERNEL_VERSION KERNEL_PATCHLEVEL KERNEL_SUBLEVEL KERNEL_EXTRAVERSION
+
+	[ "$BENCH_FORMAT" ] && env_add_params BENCH_FORMAT
+	[ "$CONSOLE" ] && env_add_params CONSOLE
+	[ "$TRACE" ] && env_add_params TRACE
+	[ "$SNAPSHOT" ] && env_add_params SNAPSHOT
+	[ "$REPORT_TIMING" ] && env_add_params REPORT_TIMING
+	return 0
 }
 
 env_file ()
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+#
+# Collect the machine-readable benchmark records ("BENCH: " and
+# "BENCH-CSV: " lines, see lib/bench.h) from test logs and write them,
+# together with a description of the host, to one JSON file per run.
+#
+# usage: bench_collect.py [-o OUTDIR] [-r RUN_ID] [LOGDIR_OR_FILE...]
+#
+# With no inputs, logs/ (as written by run_tests.sh) is used; "-" reads a
+# single log from stdin.  The name of each log file, without ".log", is
+# recorded as the unittests.cfg test name of the records found in it.
+
+import argparse
+import glob
+import json
+import os
+import platform
+import subprocess
+import sys
+import time
+
+SCHEMA_VERSION = 1
+
+# Must match the CSV header printed by lib/bench.c.
+CSV_INT_FIELDS = ('schema', 'cpu', 'iterations', 'ticks', 'freq', 'ns',
+                  'min', 'p50', 'p90', 'p99', 'p999', 'max')
+
+def parse_csv(header, line):
+    record = dict(zip(header, line.split(',')))
+    for key in CSV_INT_FIELDS:
+        if key in record:
+            record[key] = int(record[key]) if record[key] != '' else None
+    return record
+
+def parse_log(f, test):
+    records = []
+    header = None
+    for line in f:
+        line = line.rstrip('\r\n')
+        if line.startswith('BENCH: '):
+            try:
+                record = json.loads(line[len('BENCH: '):])
+            except ValueError:
+                sys.stderr.write('%s: skipping malformed record: %s\n' % (test, line))
+                continue
+        elif line.startswith('BENCH-CSV: '):
+            fields = line[len('BENCH-CSV: '):]
+            if fields.startswith('schema,'):
+                header = fields.split(',')
+                continue
+            if header is None:
+                sys.stderr.write('%s: CSV record without header: %s\n' % (test, line))
+                continue
+            record = parse_csv(header, fields)
+        else:
+            continue
+        if test:
+            record['test'] = test
+        records.append(record)
+    return records
+
+def log_files(paths):
+    for path in paths:
+        if os.path.isdir(path):
+            for log in sorted(glob.glob(os.path.join(path, '*.log'))):
+                yield log
+        else:
+            yield path
+
+def build_head(paths):
+    for path in paths:
+        summary = os.path.join(path, 'SUMMARY')
+        if not os.path.isfile(summary):
+            continue
+        with open(summary) as f:
+            for line in f:
+                if line.startswith('BUILD_HEAD='):
+                    return line.strip().partition('=')[2]
+    return None
+
+def qemu_version():
+    qemu = os.environ.get('QEMU')
+    if not qemu:
+        return None
+    try:
+        out = subprocess.run([qemu, '--version'], stdout=subprocess.PIPE,
+                             stderr=subprocess.DEVNULL, check=True).stdout
+    except (OSError, subprocess.CalledProcessError):
+        return None
+    return out.decode().splitlines()[0]
+
+def main():
+    parser = argparse.ArgumentParser(description='Collect benchmark results from test logs.')
+    parser.add_argument('-o', '--outdir', default='bench-results',
+                        help='directory to write the run file to (default: %(default)s)')
+    parser.add_argument('-r', '--run-id',
+                        help='name of the run file (default: <host>-<kernel>-<time>)')
+    parser.add_argument('inputs', nargs='*', default=['logs'],
+                        help='log files or directories of logs, "-" for stdin')
+    args = parser.parse_args()
+
+    records = []
+    for path in log_files(args.inputs):
+        if path == '-':
+            records += parse_log(sys.stdin, None)
+            continue
+        test = os.path.basename(path)
+        if test.endswith('.log'):
+            test = test[:-len('.log')]
+        with open(path, errors='replace') as f:
+            records += parse_log(f, test)
+
+    if not records:
+        sys.stderr.write('no benchmark records found\n')
+        sys.exit(1)
+
+    now = time.time()
+    uname = platform.uname()
+    run = {
+        'schema': SCHEMA_VERSION,
+        'timestamp': time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime(now)),
+        'host': uname.node,
+        'kernel': uname.release,
+        'machine': uname.machine,
+        'qemu': qemu_version(),
+        'build_head': build_head(args.inputs),
+        'results': records,
+    }
+
+    run_id = args.run_id
+    if not run_id:
+        run_id = '%s-%s-%s' % (uname.node, uname.release,
+                               time.strftime('%Y%m%d-%H%M%S', time.gmtime(now)))
+
+    os.makedirs(args.outdir, exist_ok=True)
+    out = os.path.join(args.outdir, run_id + '.json')
+    with open(out, 'w') as f:
+        json.dump(run, f, indent=1, sort_keys=True)
+        f.write('\n')
+    print(out)
+
+if __name__ == '__main__':
+    main()
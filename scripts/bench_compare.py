@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+#
+# Compare the benchmark records of a run (see lib/bench.h) against a
+# baseline and report regressions.
+#
+# usage: bench_compare.py [-t TOLERANCE] BASELINE [LOGDIR_OR_FILE...]
+#
+# The baseline is a text file with one metric per line:
+#
+#   # <test> <name> <metric> <value> [<tolerance %>]
+#   vmexit_cpuid cpuid avg 1234 5
+#   vmexit_cpuid cpuid p99 1500 10
+#
+# <test> is the unittests.cfg test name, <name> the benchmark record name
+# and <metric> one of avg, min, p50, p90, p99, p999 or max, all in clock
+# ticks of the record's clock (cycles for TSC based x86 benchmarks).  As
+# all metrics are costs, only increases beyond the tolerance are reported
+# as regressions.  Baselines are only meaningful for the host they were
+# recorded on.
+#
+# If BASELINE does not exist it is created from the current run.  Exits
+# with 1 if any metric regressed or is missing from the run.
+
+import argparse
+import os
+import sys
+
+from bench_collect import log_files, parse_log
+
+METRICS = ('avg', 'min', 'p50', 'p90', 'p99', 'p999', 'max')
+
+# Metrics and tolerances written to a freshly created baseline.
+DEFAULT_METRICS = (('avg', 5), ('p50', 5), ('p99', 10))
+
+def PASS(): return '\x1b[32mPASS\x1b[0m'
+def FAIL(): return '\x1b[31mFAIL\x1b[0m'
+
+def record_metrics(record):
+    metrics = {}
+    if record.get('iterations'):
+        metrics['avg'] = record['ticks'] / record['iterations']
+    for metric in METRICS[1:]:
+        if record.get(metric) is not None:
+            metrics[metric] = record[metric]
+    return metrics
+
+def read_results(inputs):
+    results = {}
+    for path in log_files(inputs):
+        test = os.path.basename(path)
+        if test.endswith('.log'):
+            test = test[:-len('.log')]
+        with open(path, errors='replace') as f:
+            for record in parse_log(f, test):
+                # Per-cpu records are informational only.
+                if record.get('cpu', -1) != -1:
+                    continue
+                results[(test, record['name'])] = record_metrics(record)
+    return results
+
+def read_baseline(path, default_tolerance):
+    baseline = []
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            fields = line.split('#', 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) not in (4, 5) or fields[2] not in METRICS:
+                sys.stderr.write('%s:%d: malformed baseline entry\n' % (path, lineno))
+                sys.exit(2)
+            tolerance = float(fields[4]) if len(fields) == 5 else default_tolerance
+            baseline.append((fields[0], fields[1], fields[2],
+                             float(fields[3]), tolerance))
+    return baseline
+
+def write_baseline(path, results):
+    with open(path, 'w') as f:
+        f.write('# <test> <name> <metric> <value> [<tolerance %>]\n')
+        for (test, name), metrics in sorted(results.items()):
+            for metric, tolerance in DEFAULT_METRICS:
+                if metric in metrics:
+                    f.write('%s %s %s %d %d\n' % (test, name, metric,
+                                                  round(metrics[metric]), tolerance))
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare benchmark results against a baseline.')
+    parser.add_argument('-t', '--tolerance', type=float, default=5,
+                        help='tolerance in percent for entries without one (default: %(default)s)')
+    parser.add_argument('baseline', help='baseline file')
+    parser.add_argument('inputs', nargs='*', default=['logs'],
+                        help='log files or directories of logs')
+    args = parser.parse_args()
+
+    results = read_results(args.inputs)
+    if not results:
+        sys.stderr.write('no benchmark records found\n')
+        sys.exit(2)
+
+    if not os.path.exists(args.baseline):
+        write_baseline(args.baseline, results)
+        print('created baseline %s' % args.baseline)
+        return
+
+    failed = False
+    for test, name, metric, base, tolerance in read_baseline(args.baseline, args.tolerance):
+        label = '%s.%s.%s' % (test, name, metric)
+        value = results.get((test, name), {}).get(metric)
+        if value is None:
+            # Only tests that ran, but lost a record, count as failures.
+            if any(t == test for t, _ in results):
+                print('%s %s (missing from results)' % (FAIL(), label))
+                failed = True
+            continue
+        delta = (value - base) * 100 / base if base else 0
+        if delta > tolerance:
+            print('%s %s %d (baseline %d, %+.1f%% > %g%%: regression)' %
+                  (FAIL(), label, round(value), round(base), delta, tolerance))
+            failed = True
+        else:
+            print('%s %s %d (baseline %d, %+.1f%%)' %
+                  (PASS(), label, round(value), round(base), delta))
+
+    sys.exit(1 if failed else 0)
+
+if __name__ == '__main__':
+    main()
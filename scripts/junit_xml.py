@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+#
+# Write the results of a run_tests.sh run as JUnit XML.
+#
+# usage: junit_xml.py [-o FILE] [-n NAME] LOGDIR
+#
+# Each unittests.cfg test becomes a <testsuite> with its wall time, from
+# LOGDIR/durations.new (or LOGDIR/durations), and each of its reports
+# (PASS, FAIL, SKIP, XPASS and XFAIL lines in its log) a <testcase> of it.
+# Reports are timed if the test ran with REPORT_TIMING set, see
+# lib/report.c, and run_tests.sh --junit sets it.  Tests without reports
+# (e.g. skipped by the runner), or that failed without a failed report
+# (e.g. timeouts), get a <testcase> named after the test carrying the
+# runner's result.
+
+import argparse
+import os
+import re
+import sys
+from xml.sax.saxutils import quoteattr, escape
+
+# Characters that XML 1.0 does not allow, even escaped
+INVALID = re.compile('[\x00-\x08\x0b\x0c\x0e-\x1f]')
+
+REPORT = re.compile(r'^(PASS|FAIL|SKIP|XPASS|XFAIL): (.*)$')
+TIMING = re.compile(r'^TIMING: (\d+)$')
+
+def text(s):
+    return escape(INVALID.sub('?', s))
+
+def attr(s):
+    return quoteattr(INVALID.sub('?', s))
+
+def read_results(logdir):
+    results = []
+    path = os.path.join(logdir, 'results')
+    if os.path.exists(path):
+        with open(path, errors='replace') as f:
+            for line in f:
+                fields = line.rstrip('\n').split(' ', 2)
+                if len(fields) >= 2:
+                    detail = fields[2] if len(fields) == 3 else ''
+                    results.append((fields[0], fields[1], detail.strip('()')))
+    return results
+
+def read_durations(logdir):
+    durations = {}
+    for name in ('durations', 'durations.new'):
+        path = os.path.join(logdir, name)
+        if not os.path.exists(path):
+            continue
+        with open(path) as f:
+            for line in f:
+                fields = line.split()
+                if len(fields) == 2 and fields[1].isdigit():
+                    durations[fields[0]] = int(fields[1]) / 1000.0
+    return durations
+
+def read_reports(logdir, test):
+    reports = []
+    output = ''
+    path = os.path.join(logdir, test + '.log')
+    if not os.path.exists(path):
+        return reports, output
+    with open(path, errors='replace') as f:
+        output = f.read()
+    for line in output.splitlines():
+        m = REPORT.match(line)
+        if m:
+            reports.append([m.group(1), m.group(2), None])
+            continue
+        m = TIMING.match(line)
+        if m and reports and reports[-1][2] is None:
+            reports[-1][2] = int(m.group(1)) / 1e6
+    return reports, output
+
+def testcase(out, test, name, time, status, message):
+    out.append('    <testcase classname=%s name=%s%s' %
+               (attr(test), attr(name),
+                '' if time is None else ' time="%.6f"' % time))
+    if status in ('FAIL', 'XPASS'):
+        out.append('>\n      <failure message=%s/>\n    </testcase>' % attr(message))
+    elif status == 'SKIP':
+        out.append('>\n      <skipped message=%s/>\n    </testcase>' % attr(message))
+    else:
+        out.append('/>')
+    out.append('\n')
+
+def main():
+    parser = argparse.ArgumentParser(description='Write run_tests.sh results as JUnit XML.')
+    parser.add_argument('-o', '--output', help='XML file (default: stdout)')
+    parser.add_argument('-n', '--name', default='kvm-unit-tests',
+                        help='name of the <testsuites> (default: %(default)s)')
+    parser.add_argument('logdir', help='logs directory of the run')
+    args = parser.parse_args()
+
+    if not os.path.isdir(args.logdir):
+        sys.stderr.write('%s is not a directory\n' % args.logdir)
+        sys.exit(2)
+
+    durations = read_durations(args.logdir)
+    suites = []
+    totals = {'tests': 0, 'failures': 0, 'skipped': 0, 'time': 0.0}
+
+    for status, test, detail in read_results(args.logdir):
+        reports, output = read_reports(args.logdir, test)
+        out = []
+        failures = skipped = 0
+
+        for kind, name, time in reports:
+            testcase(out, test, name, time, kind, name)
+            failures += kind in ('FAIL', 'XPASS')
+            skipped += kind == 'SKIP'
+        count = len(reports)
+
+        # Results the reports do not account for
+        if not reports or (status == 'FAIL' and not failures):
+            testcase(out, test, test, None, status, detail)
+            failures += status == 'FAIL'
+            skipped += status == 'SKIP'
+            count += 1
+
+        time = durations.get(test)
+        suites.append('  <testsuite name=%s tests="%d" failures="%d" skipped="%d"%s>\n%s'
+                      '    <system-out>%s</system-out>\n  </testsuite>\n' %
+                      (attr(test), count, failures, skipped,
+                       '' if time is None else ' time="%.3f"' % time,
+                       ''.join(out), text(output)))
+        totals['tests'] += count
+        totals['failures'] += failures
+        totals['skipped'] += skipped
+        totals['time'] += time or 0
+
+    xml = ('<?xml version="1.0" encoding="UTF-8"?>\n'
+           '<testsuites name=%s tests="%d" failures="%d" skipped="%d" time="%.3f">\n%s'
+           '</testsuites>\n' %
+           (attr(args.name), totals['tests'], totals['failures'],
+            totals['skipped'], totals['time'], ''.join(suites)))
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(xml)
+    else:
+        sys.stdout.write(xml)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+#
+# Merge the logs directories of a sharded run (run_tests.sh --shard) into
+# one and print the combined summary.
+#
+# usage: merge_shards.py [-o OUTDIR] [-t TAP...] LOGDIR...
+#
+# The test logs, results and durations of all LOGDIRs are combined in
+# OUTDIR (default: logs-merged).  OUTDIR/durations can be passed to the
+# next run's --shard-durations to balance its shards.  TAP streams of the
+# shards (run_tests.sh -t output) given with -t are renumbered into one,
+# OUTDIR/results.tap.
+#
+# Exits with 1 if any test failed, a shard is missing or two shards ran
+# the same test, and with 2 if the inputs are unusable.
+
+import argparse
+import os
+import re
+import shutil
+import sys
+
+def read_summary(logdir):
+    summary = {}
+    path = os.path.join(logdir, 'SUMMARY')
+    if os.path.exists(path):
+        with open(path) as f:
+            for line in f:
+                key, _, value = line.strip().partition('=')
+                summary[key] = value
+    return summary
+
+def read_lines(logdir, name):
+    path = os.path.join(logdir, name)
+    if not os.path.exists(path):
+        return []
+    with open(path, errors='replace') as f:
+        return [line.rstrip('\n') for line in f if line.strip()]
+
+def merge_tap(paths):
+    merged = ['TAP version 13']
+    number = 0
+    for path in paths:
+        with open(path, errors='replace') as f:
+            for line in f:
+                line = line.rstrip('\n')
+                if line == 'TAP version 13' or re.match(r'^1\.\.\d+$', line):
+                    continue
+                m = re.match(r'^(ok|not ok) \d+ (.*)$', line)
+                if m:
+                    number += 1
+                    line = '%s %d %s' % (m.group(1), number, m.group(2))
+                merged.append(line)
+    merged.append('1..%d' % number)
+    return merged
+
+def main():
+    parser = argparse.ArgumentParser(description='Merge the logs of a sharded run.')
+    parser.add_argument('-o', '--output', default='logs-merged',
+                        help='merged logs directory (default: %(default)s)')
+    parser.add_argument('-t', '--tap', action='append', default=[],
+                        help='TAP stream of a shard (can be repeated)')
+    parser.add_argument('logdirs', nargs='+', help='logs directories of the shards')
+    args = parser.parse_args()
+
+    problems = []
+    heads = set()
+    shards = {}
+    results = []
+    owner = {}
+    shard_durations = {}
+
+    os.makedirs(args.output, exist_ok=True)
+
+    for logdir in args.logdirs:
+        if not os.path.isdir(logdir):
+            sys.stderr.write('%s is not a directory\n' % logdir)
+            sys.exit(2)
+        summary = read_summary(logdir)
+        if 'BUILD_HEAD' in summary:
+            heads.add(summary['BUILD_HEAD'])
+        if 'SHARD' in summary:
+            index, _, count = summary['SHARD'].partition('/')
+            shards.setdefault(int(count), set()).add(int(index))
+
+        for line in read_lines(logdir, 'results'):
+            status, _, rest = line.partition(' ')
+            test, _, detail = rest.partition(' ')
+            if test in owner:
+                problems.append('%s ran in both %s and %s' % (test, owner[test], logdir))
+                continue
+            owner[test] = logdir
+            results.append((status, test, detail))
+
+        shard_durations[logdir] = {}
+        for line in read_lines(logdir, 'durations'):
+            fields = line.split()
+            if len(fields) == 2 and fields[1].isdigit():
+                shard_durations[logdir][fields[0]] = int(fields[1])
+
+        for name in os.listdir(logdir):
+            if name.endswith('.log'):
+                shutil.copy(os.path.join(logdir, name), args.output)
+
+    # Each shard also carries the durations of earlier runs, prefer the
+    # ones from the shard that ran the test.
+    durations = {}
+    for logdir, times in shard_durations.items():
+        for test, ms in times.items():
+            if owner.get(test, logdir) == logdir or test not in durations:
+                durations[test] = ms
+
+    if len(heads) > 1:
+        problems.append('shards built from different heads: %s' % ', '.join(sorted(heads)))
+    if len(shards) > 1:
+        problems.append('shards of different splits: %s' %
+                        ', '.join('%d' % c for c in sorted(shards)))
+    for count, indices in shards.items():
+        missing = sorted(set(range(1, count + 1)) - indices)
+        if missing:
+            problems.append('missing shard(s) %s of %d' %
+                            (', '.join('%d' % i for i in missing), count))
+
+    with open(os.path.join(args.output, 'SUMMARY'), 'w') as f:
+        for head in sorted(heads):
+            f.write('BUILD_HEAD=%s\n' % head)
+        for count, indices in sorted(shards.items()):
+            f.write('SHARDS=%s/%d\n' % (','.join('%d' % i for i in sorted(indices)), count))
+
+    results.sort(key=lambda r: r[1])
+    with open(os.path.join(args.output, 'results'), 'w') as f:
+        for status, test, detail in results:
+            f.write('%s %s %s\n' % (status, test, detail))
+
+    with open(os.path.join(args.output, 'durations'), 'w') as f:
+        for test in sorted(durations):
+            f.write('%s %d\n' % (test, durations[test]))
+
+    if args.tap:
+        with open(os.path.join(args.output, 'results.tap'), 'w') as f:
+            f.write('\n'.join(merge_tap(args.tap)) + '\n')
+
+    counts = {}
+    for status, test, detail in results:
+        counts[status] = counts.get(status, 0) + 1
+        if status == 'FAIL':
+            print('FAIL %s %s' % (test, detail))
+
+    print('%d tests from %d shard(s): %d passed, %d failed, %d skipped' %
+          (len(results), len(args.logdirs), counts.get('PASS', 0),
+           counts.get('FAIL', 0), counts.get('SKIP', 0)))
+    for problem in problems:
+        print('ERROR: %s' % problem)
+
+    sys.exit(1 if counts.get('FAIL') or problems else 0)
+
+if __name__ == '__main__':
+    main()
@@ -71,8 +71,7 @@ generate_test ()
 	 cat scripts/arch-run.bash "$TEST_DIR/run") | temp_file RUNTIME_arch_run
 
 	echo "exec {stdout}>&1"
-	echo "RUNTIME_log_stdout () { cat >&\$stdout; }"
-	echo "RUNTIME_log_stderr () { cat >&2; }"
+	echo "RUNTIME_log_file=/dev/fd/\$stdout"
 
 	cat scripts/runtime.bash
 
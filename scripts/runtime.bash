@@ -6,27 +6,85 @@ PASS() { echo -ne "\e[32mPASS\e[0m"; }
 SKIP() { echo -ne "\e[33mSKIP\e[0m"; }
 FAIL() { echo -ne "\e[31mFAIL\e[0m"; }
 
-extract_summary()
+#
+# log_output TESTNAME: the single pass over the output of a test.  The
+# lines are appended to $RUNTIME_log_file as they come, with TAP lines for
+# the PASS, FAIL and SKIP reports written to fd 3 if RUNTIME_log_tap is
+# "yes", and the SUMMARY line among the last three is printed in
+# parentheses as the test's summary.  TEST_NUMBER in the TAP lines is left
+# for the caller to fill in.
+#
+log_output()
 {
-    local cr=$'\r'
-    tail -3 | grep '^SUMMARY: ' | sed 's/^SUMMARY: /(/;s/'"$cr"'\{0,1\}$/)/'
+    awk -v testname="$1" -v logfile="${RUNTIME_log_file:-/dev/null}" \
+        -v tap="$RUNTIME_log_tap" '
+        {
+            sub(/\r$/, "")
+            print >> logfile
+            fflush(logfile)
+            last[NR % 3] = $0
+            if (tap != "yes")
+                next
+            kind = substr($0, 1, 4)
+            if (kind == "PASS")
+                print "ok TEST_NUMBER - " testname ": " substr($0, 7) > "/dev/fd/3"
+            else if (kind == "FAIL")
+                print "not ok TEST_NUMBER - " testname ": " substr($0, 7) > "/dev/fd/3"
+            else if (kind == "SKIP")
+                print "ok TEST_NUMBER - " testname ": " substr($0, 7) " # skip" > "/dev/fd/3"
+            else
+                next
+            fflush("/dev/fd/3")
+        }
+        END {
+            for (i = NR > 2 ? NR - 2 : 1; i <= NR; i++)
+                if (last[i % 3] ~ /^SUMMARY: /)
+                    print "(" substr(last[i % 3], 10) ")"
+        }'
 }
 
 # We assume that QEMU is going to work if it tried to load the kernel
 premature_failure()
 {
-    local log="$(eval $(get_cmdline _NO_FILE_4Uhere_) 2>&1)"
+    local log
+
+    # The dry run does not depend on the test, so it can be cached by its
+    # options (see qemu_probe in arch-run.bash), as long as the test's name
+    # is left out of the command line.
+    if [ "$(type -t qemu_probe)" = "function" ]; then
+        log="$(testname=; qemu_probe eval $(get_cmdline _NO_FILE_4Uhere_))"
+    else
+        log="$(eval $(get_cmdline _NO_FILE_4Uhere_) 2>&1)"
+    fi
 
     echo "$log" | grep "_NO_FILE_4Uhere_" |
         grep -q -e "could not \(load\|open\) kernel" -e "error loading" &&
         return 1
 
-    RUNTIME_log_stderr <<< "$log"
+    log_output $testname <<< "$log" > /dev/null
 
     echo "$log"
     return 0
 }
 
+# Prints the path of a new sparse disk image of the given size, e.g.
+# "extra_params = -drive file=`scratch_disk 64M`,format=raw,...".  The
+# image lives in the test's scratch directory, which run() creates for
+# tests whose extra_params use scratch_disk and removes after the test.
+scratch_disk()
+{
+    local img
+
+    img=$(mktemp -p "$RUNTIME_scratch_dir" disk.XXXXXXXXXX) &&
+        truncate -s "$1" "$img" && echo "$img"
+}
+
+scratch_cleanup()
+{
+    [ "$RUNTIME_scratch_dir" ] && rm -rf "$RUNTIME_scratch_dir"
+    RUNTIME_scratch_dir=
+}
+
 get_cmdline()
 {
     local kernel=$1
@@ -63,6 +121,10 @@ function print_result()
     else
         echo "`$status` $testname ($reason)"
     fi
+
+    if [ "$(type -t RUNTIME_log_result)" = "function" ]; then
+        RUNTIME_log_result "$status" "$testname" "$summary" "$reason"
+    fi
 }
 
 function find_word()
@@ -126,7 +188,12 @@ function run()
         done
     fi
 
+    if [[ $opts == *scratch_disk* ]]; then
+        RUNTIME_scratch_dir=$(mktemp -d -t kvm-unit-tests-scratch.XXXXXXXXXX)
+    fi
+
     last_line=$(premature_failure > >(tail -1)) && {
+        scratch_cleanup
         print_result "SKIP" $testname "" "$last_line"
         return 77
     }
@@ -134,18 +201,31 @@ function run()
     cmdline=$(get_cmdline $kernel)
     if grep -qw "migration" <<<$groups ; then
         cmdline="MIGRATION=yes $cmdline"
+    elif [ -d "$KVM_UNIT_TESTS_SNAPSHOT_DIR" ] && find_word snapshot "$groups" &&
+         find_word "$testname" "$snapshot_tests"; then
+        cmdline="SNAPSHOT=yes $cmdline"
     fi
     if [ "$verbose" = "yes" ]; then
         echo $cmdline
     fi
 
     # extra_params in the config file may contain backticks that need to be
-    # expanded, so use eval to start qemu.  Use "> >(foo)" instead of a pipe to
-    # preserve the exit status.
-    summary=$(eval $cmdline 2> >(RUNTIME_log_stderr $testname) \
-                             > >(tee >(RUNTIME_log_stdout $testname $kernel) | extract_summary))
+    # expanded, so use eval to start qemu.  stdout and stderr go through
+    # one pipe to keep their order in the log, pipefail preserves the exit
+    # status.
+    start_ms=$(date +%s%3N)
+    if [ "$STANDALONE" != "yes" ] && [ "$PRETTY_PRINT_STACKS" = "yes" ]; then
+        summary=$(set -o pipefail; eval $cmdline 2>&1 |
+                  ./scripts/pretty_print_stacks.py $kernel | log_output $testname)
+    else
+        summary=$(set -o pipefail; eval $cmdline 2>&1 | log_output $testname)
+    fi
     ret=$?
-    [ "$STANDALONE" != "yes" ] && echo > >(RUNTIME_log_stdout $testname $kernel)
+    scratch_cleanup
+    if [ "$(type -t RUNTIME_log_duration)" = "function" ]; then
+        RUNTIME_log_duration $testname $(( $(date +%s%3N) - start_ms ))
+    fi
+    [ "$STANDALONE" != "yes" ] && echo >> $RUNTIME_log_file
 
     if [ $ret -eq 0 ]; then
         print_result "PASS" $testname "$summary"
@@ -0,0 +1,92 @@
+#
+# Split a list of tests into shards, e.g. to spread a run over several
+# identical hosts.  The split only depends on the list of test names and,
+# if one is given, on a durations file of "<test> <ms>" lines (as written
+# to logs/durations by run_tests.sh, or merged by merge_shards.py), so every
+# runner must use the same file to get disjoint shards that cover all tests.
+#
+# Without durations each test goes to the shard given by a hash of its
+# name, so adding or removing a test does not move any other.  With
+# durations the tests are handed out longest first, each to the shard with
+# the least total duration so far, ties broken by name and shard number.
+# Tests missing from the file count as the average test.
+#
+# Sourced by run_tests.sh; executed, it prints the names of the tests in
+# one shard, e.g. to pick standalone tests:
+#
+#   ls tests | scripts/shard.bash [-d DURATIONS] INDEX/COUNT
+#
+# INDEX counts from 1.  Names are read from stdin if not given as arguments.
+#
+
+# shard_tests INDEX COUNT DURATIONS NAME...
+shard_tests ()
+{
+	local index=$1 count=$2 durations=$3
+	local -A ms
+	local -a load
+	local name t total=0 known=0 i best
+
+	shift 3
+
+	if [ ! -f "$durations" ]; then
+		for name in "$@"; do
+			read -r t _ < <(cksum <<<"$name")
+			(( t % count == index - 1 )) && echo "$name"
+		done
+		return 0
+	fi
+
+	while read -r name t; do
+		[[ "$t" =~ ^[0-9]+$ ]] || continue
+		ms[$name]=$t
+	done < "$durations"
+
+	for name in "$@"; do
+		[ "${ms[$name]}" ] && (( total += ms[$name], known++ ))
+	done
+	(( known )) && (( total /= known ))
+
+	for (( i = 0; i < count; i++ )); do
+		load[i]=0
+	done
+
+	while read -r t name; do
+		best=0
+		for (( i = 1; i < count; i++ )); do
+			(( load[i] < load[best] )) && best=$i
+		done
+		(( load[best] += t ))
+		(( best == index - 1 )) && echo "$name"
+	done < <(for name in "$@"; do
+			echo "${ms[$name]:-$total} $name"
+		 done | LC_ALL=C sort -k1,1nr -k2,2)
+	return 0
+}
+
+# parse_shard INDEX/COUNT: checks the argument, prints "INDEX COUNT"
+parse_shard ()
+{
+	if ! [[ "$1" =~ ^([0-9]+)/([0-9]+)$ ]] ||
+	   (( BASH_REMATCH[1] < 1 || BASH_REMATCH[1] > BASH_REMATCH[2] )); then
+		echo "Invalid shard '$1', expected INDEX/COUNT with 1 <= INDEX <= COUNT" >&2
+		return 2
+	fi
+	echo "${BASH_REMATCH[1]} ${BASH_REMATCH[2]}"
+}
+
+if [ "${BASH_SOURCE[0]}" = "$0" ]; then
+	durations=
+	if [ "$1" = "-d" ]; then
+		durations=$2
+		[ -f "$durations" ] || { echo "$durations not found" >&2; exit 2; }
+		shift 2
+	fi
+	shard=$(parse_shard "$1") || exit 2
+	shift
+	if [ $# -eq 0 ]; then
+		mapfile -t names
+		set -- "${names[@]}"
+	fi
+	shard_tests $shard "$durations" "$@"
+fi
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+#
+# Decode the trace rings dumped by lib/trace.c ("TRACE..." lines) from a
+# test log into one timeline of all CPUs, ordered by timestamp.
+#
+# usage: trace_decode.py [-c CPU] [-e EVENT] [--ticks] [LOG...]
+#
+# With no LOG, or "-", the log is read from stdin.  Times are relative to
+# the first event shown and in microseconds if the dump carried the clock
+# frequency, in clock ticks otherwise or with --ticks.  Each dump found in
+# the logs is decoded separately.
+
+import argparse
+import sys
+
+def parse_dumps(f):
+    dump = None
+    for line in f:
+        line = line.rstrip('\r\n')
+        # Tolerate prefixes, e.g. from serial consoles or timestamps.
+        pos = line.find('TRACE')
+        if pos < 0:
+            continue
+        tag, _, rest = line[pos:].partition(': ')
+        fields = rest.split()
+        if tag == 'TRACE-START':
+            opts = dict(zip(fields[::2], fields[1::2]))
+            dump = {'hz': int(opts.get('hz', 0)), 'events': {},
+                    'entries': [], 'lost': 0, 'last': {}}
+        elif dump is None:
+            continue
+        elif tag == 'TRACE-EVENT':
+            dump['events'][int(fields[0], 16)] = rest.split(None, 1)[1]
+        elif tag == 'TRACE' and len(fields) == 5:
+            cpu = int(fields[0], 16)
+            ts = dump['last'].get(cpu, 0) + int(fields[1])
+            dump['last'][cpu] = ts
+            dump['entries'].append((ts, cpu, int(fields[2], 16),
+                                    int(fields[3], 16), int(fields[4], 16)))
+        elif tag == 'TRACE-END':
+            dump['lost'] = int(fields[1])
+            yield dump
+            dump = None
+    if dump is not None:
+        sys.stderr.write('warning: truncated trace dump\n')
+        yield dump
+
+def print_dump(dump, args):
+    entries = sorted(dump['entries'], key=lambda e: e[0])
+    if args.cpu is not None:
+        entries = [e for e in entries if e[1] == args.cpu]
+    if args.event:
+        entries = [e for e in entries
+                   if dump['events'].get(e[2], '?') in args.event]
+
+    hz = 0 if args.ticks else dump['hz']
+    unit = 'us' if hz else 'ticks'
+    if dump['lost']:
+        print('# %d entries lost to wrap-around, the oldest ones are missing'
+              % dump['lost'])
+    print('%14s %12s %4s  %-24s %18s %18s' % ('time/' + unit, 'delta', 'cpu',
+                                              'event', 'arg0', 'arg1'))
+    if not entries:
+        return
+
+    start = prev = entries[0][0]
+    for ts, cpu, event, arg0, arg1 in entries:
+        if hz:
+            time = '%.3f' % ((ts - start) * 1e6 / hz)
+            delta = '+%.3f' % ((ts - prev) * 1e6 / hz)
+        else:
+            time = '%d' % (ts - start)
+            delta = '+%d' % (ts - prev)
+        print('%14s %12s %4d  %-24s %#18x %#18x' %
+              (time, delta, cpu, dump['events'].get(event, '?'), arg0, arg1))
+        prev = ts
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode trace ring dumps.')
+    parser.add_argument('-c', '--cpu', type=int,
+                        help='only show the events of this CPU')
+    parser.add_argument('-e', '--event', action='append',
+                        help='only show this event (can be repeated)')
+    parser.add_argument('--ticks', action='store_true',
+                        help='show times in clock ticks')
+    parser.add_argument('logs', nargs='*', default=['-'], help='test logs')
+    args = parser.parse_args()
+
+    found = False
+    for path in args.logs:
+        f = sys.stdin if path == '-' else open(path, errors='replace')
+        for dump in parse_dumps(f):
+            if found:
+                print()
+            print_dump(dump, args)
+            found = True
+        if f is not sys.stdin:
+            f.close()
+
+    if not found:
+        sys.stderr.write('no trace dump found\n')
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()
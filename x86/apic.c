@@ -7,6 +7,7 @@
 #include "msr.h"
 #include "atomic.h"
 #include "fwcfg.h"
+#include "trace.h"
 
 #define MAX_TPR			0xf
 
@@ -26,6 +27,7 @@ static int tdt_count;
 
 static void tsc_deadline_timer_isr(isr_regs_t *regs)
 {
+    trace("tsc-deadline-irq", tdt_count, 0);
     ++tdt_count;
     eoi();
 }
@@ -262,6 +264,7 @@ static int ipi_count;
 
 static void self_ipi_isr(isr_regs_t *regs)
 {
+    trace("self-ipi-irq", ipi_count, 0);
     ++ipi_count;
     eoi();
 }
@@ -394,6 +397,7 @@ static volatile int cpu0_nmi_ctr2, cpu1_nmi_ctr2;
 
 static void multiple_nmi_handler(isr_regs_t *regs)
 {
+    trace("multiple-nmi", smp_id(), nmi_received);
     ++nmi_received;
 }
 
@@ -493,6 +497,7 @@ static volatile int lvtt_counter = 0;
 
 static void lvtt_handler(isr_regs_t *regs)
 {
+    trace("lvtt-irq", lvtt_counter, 0);
     lvtt_counter++;
     eoi();
 }
@@ -688,6 +693,7 @@ static void test_pv_ipi(void)
 int main(void)
 {
     setup_vm();
+    trace_enable_env();
 
     test_lapic_existence();
 
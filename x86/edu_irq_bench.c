@@ -0,0 +1,323 @@
+/*
+ * Device interrupt delivery latency benchmark.
+ *
+ * Routes the interrupt of QEMU's edu device to each CPU in turn and, from
+ * CPU 0, measures how long it takes an interrupt raised by the device to
+ * reach the handler on that CPU:
+ *
+ *  - raise: the interrupt is raised by a write to the device's
+ *    interrupt raise register, timed from just before the write;
+ *  - dma:   the interrupt is raised by the device on completion of a
+ *    DMA.  The device completes a DMA on a timer, about 100 ms after it
+ *    was started, so CPU 0 polls the DMA status and the latency is timed
+ *    from the return of the last read that still found the DMA running.
+ *    It is an upper bound, the cost of the final poll read ("dma-poll")
+ *    is the uncertainty.  As each DMA takes that long, only CPU 0 and
+ *    the next DMA_TARGETS - 1 CPUs are targeted.
+ *
+ * The target CPU is either CPU 0 itself ("local"), or another CPU that
+ * is busy in the guest ("spin") or halted ("halt"), which exercises the
+ * host's delivery to a running vCPU and its wakeup of a blocked one,
+ * e.g. with and without posted interrupts.  For the latter set gap=N
+ * above the host's halt_poll_ns, so that the vCPU is really blocked when
+ * the interrupt comes.
+ *
+ * The device is programmed through MSI-X if it has it, through MSI
+ * otherwise.  QEMU signals the edu interrupt from its MMIO emulation with
+ * KVM_SIGNAL_MSI; the irqfd path of a virtio device is measured by
+ * virtio_mq_bench.  Times are in TSC cycles, whose synchronization
+ * across CPUs is taken for granted.
+ *
+ * An interrupt that does not arrive within TIMEOUT_MS fails the target
+ * and ends its measurement.
+ *
+ * usage: edu_irq_bench.flat [--json|--csv] [n=N] [dma=N] [gap=N]
+ *
+ *   n=N        interrupts raised per target (default 10000)
+ *   dma=N      DMA completions per target (default 10, 0 to skip)
+ *   gap=N      microseconds between two interrupts (default 0)
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "alloc_page.h"
+#include "apic.h"
+#include "bench.h"
+#include "delay.h"
+#include "histogram.h"
+#include "isr.h"
+#include "pci-edu.h"
+#include "processor.h"
+#include "smp.h"
+#include "vmalloc.h"
+
+#define EDU_VECTOR	0x62
+#define EDU_INTR_BENCH	0x1
+#define DMA_SIZE	64
+#define DMA_TARGETS	4
+#define TIMEOUT_MS	1000
+#define TIMEOUT		(1ull << 32)	/* TSC cycles, if tsc_hz() is unknown */
+
+enum target_state {
+	TARGET_LOCAL,
+	TARGET_SPIN,
+	TARGET_HALT,
+};
+
+static const char *state_names[] = {
+	[TARGET_LOCAL] = "local",
+	[TARGET_SPIN] = "spin",
+	[TARGET_HALT] = "halt",
+};
+
+static struct pci_edu_dev edu;
+static bool msix;
+static void *dma_buf;
+static u64 hz, gap, timeout;
+static long raise_samples = 10000, dma_samples = 10;
+
+/* Only one interrupt is in flight at a time */
+static volatile u64 irq_tsc;
+static volatile int irq_apic;
+
+static bool cur_halt;
+static volatile bool target_ready, target_stop;
+
+static void edu_isr(isr_regs_t *regs)
+{
+	u64 now = rdtsc();
+
+	irq_apic = smp_id();
+	irq_tsc = now;
+	eoi();
+}
+
+static void route_irq(int cpu)
+{
+	u64 addr = APIC_DEFAULT_PHYS_BASE | (id_map[cpu] << 12);
+
+	if (msix)
+		pci_setup_msix(&edu.pci_dev, 0, addr, EDU_VECTOR);
+	else
+		pci_setup_msi(&edu.pci_dev, addr, EDU_VECTOR);
+}
+
+static void target_loop(void *data)
+{
+	target_ready = true;
+
+	if (!cur_halt) {
+		irq_enable();
+		while (!target_stop)
+			pause();
+		irq_disable();
+		return;
+	}
+
+	/* Check with interrupts off, so that no wakeup is lost before hlt */
+	for (;;) {
+		irq_disable();
+		if (target_stop)
+			break;
+		safe_halt();
+	}
+}
+
+/* Returns the handler's timestamp, or 0 if no interrupt came */
+static u64 wait_irq(void)
+{
+	u64 t, end = rdtsc() + timeout;
+
+	while (!(t = irq_tsc) && rdtsc() < end)
+		pause();
+	return t;
+}
+
+static void wait_gap(void)
+{
+	u64 end = rdtsc() + gap;
+
+	while (rdtsc() < end)
+		pause();
+}
+
+static u64 elapsed(u64 from, u64 to)
+{
+	return (s64)(to - from) > 0 ? to - from : 0;
+}
+
+static bool sample_raise(struct histogram *write, struct histogram *lat)
+{
+	u64 t0, t1, t2;
+
+	irq_tsc = 0;
+	t0 = rdtsc();
+	edu_reg_writel(&edu, EDU_REG_INTR_RAISE, EDU_INTR_BENCH);
+	t1 = rdtsc();
+	t2 = wait_irq();
+	edu_reg_writel(&edu, EDU_REG_INTR_ACK, EDU_INTR_BENCH);
+	if (!t2)
+		return false;
+
+	hist_add(write, t1 - t0);
+	hist_add(lat, elapsed(t0, t2));
+	return true;
+}
+
+static bool sample_dma(struct histogram *poll, struct histogram *lat)
+{
+	u64 last, t1, t2, end;
+
+	irq_tsc = 0;
+	edu_dma_start(&edu, virt_to_phys(dma_buf), DMA_SIZE, 0, false, true);
+	last = rdtsc();
+	end = last + timeout;
+	while (edu_dma_busy(&edu)) {
+		last = rdtsc();
+		if (last >= end)
+			return false;
+	}
+	t1 = rdtsc();
+	t2 = wait_irq();
+	edu_reg_writel(&edu, EDU_REG_INTR_ACK, EDU_INTR_DMA_DONE);
+	if (!t2)
+		return false;
+
+	hist_add(poll, t1 - last);
+	hist_add(lat, elapsed(last, t2));
+	return true;
+}
+
+static void print_result(const char *name, int cpu, const struct histogram *hist)
+{
+	char buf[48];
+
+	snprintf(buf, sizeof(buf), "  %s@%d", name, cpu);
+	hist_print(buf, hist);
+	if (hz)
+		printf("  %s@%d ns p50 %" PRIu64 " p99 %" PRIu64 "\n", name, cpu,
+		       bench_ticks_to_ns(hist_permille(hist, 500), hz),
+		       bench_ticks_to_ns(hist_permille(hist, 990), hz));
+
+	if (bench_get_format() != BENCH_FMT_TEXT)
+		bench_emit_hist("edu_irq_bench", name, cpu, hist, hz);
+}
+
+static void run(int cpu, enum target_state state, bool dma)
+{
+	const char *kind = dma ? "dma" : "raise";
+	long i, samples = dma ? dma_samples : raise_samples;
+	struct histogram cost, lat;
+	char name[32];
+	int misrouted = 0;
+
+	hist_init(&cost);
+	hist_init(&lat);
+	route_irq(cpu);
+
+	if (state == TARGET_LOCAL) {
+		irq_enable();
+	} else {
+		cur_halt = state == TARGET_HALT;
+		target_ready = false;
+		target_stop = false;
+		on_cpu_async(cpu, target_loop, NULL);
+		while (!target_ready)
+			pause();
+	}
+
+	for (i = 0; i < samples; ++i) {
+		if (gap)
+			wait_gap();
+		if (dma ? !sample_dma(&cost, &lat) : !sample_raise(&cost, &lat))
+			break;
+		misrouted += irq_apic != id_map[cpu];
+	}
+
+	if (state == TARGET_LOCAL) {
+		irq_disable();
+	} else {
+		/*
+		 * An IPI on the same vector gets a halted target out of hlt,
+		 * even if the device's interrupts do not reach it.
+		 */
+		target_stop = true;
+		apic_icr_write(APIC_DEST_PHYSICAL | APIC_DM_FIXED | EDU_VECTOR,
+			       id_map[cpu]);
+		while (cpus_active() > 1)
+			pause();
+	}
+
+	report(i == samples && !misrouted, "%s %s cpu %d", kind,
+	       state_names[state], cpu);
+	if (i < samples)
+		report_info("%s interrupt %ld for cpu %d never came", kind,
+			    i + 1, cpu);
+	if (misrouted)
+		report_info("%d of %ld interrupts on another cpu", misrouted, i);
+
+	snprintf(name, sizeof(name), "%s-%s", kind, dma ? "poll" : "write");
+	print_result(name, cpu, &cost);
+	snprintf(name, sizeof(name), "%s-%s", kind, state_names[state]);
+	print_result(name, cpu, &lat);
+}
+
+static void run_all(bool dma)
+{
+	int cpu, ncpus = dma ? MIN(cpu_count(), DMA_TARGETS) : cpu_count();
+
+	run(0, TARGET_LOCAL, dma);
+	for (cpu = 1; cpu < ncpus; ++cpu) {
+		run(cpu, TARGET_SPIN, dma);
+		run(cpu, TARGET_HALT, dma);
+	}
+}
+
+int main(int ac, char **av)
+{
+	long gap_us = 0;
+	int i;
+
+	setup_vm();
+
+	for (i = 1; i < ac; ++i) {
+		if (bench_parse_arg(av[i]))
+			continue;
+		if (strncmp(av[i], "n=", 2) == 0 && (raise_samples = atol(av[i] + 2)) > 0)
+			continue;
+		if (strncmp(av[i], "dma=", 4) == 0 && (dma_samples = atol(av[i] + 4)) >= 0)
+			continue;
+		if (strncmp(av[i], "gap=", 4) == 0 && (gap_us = atol(av[i] + 4)) >= 0)
+			continue;
+		report_abort("unknown argument '%s'", av[i]);
+	}
+
+	if (!edu_init(&edu)) {
+		report_skip("no edu device");
+		return report_summary();
+	}
+
+	msix = edu.pci_dev.msix_offset;
+	if (!msix && !edu.pci_dev.msi_offset) {
+		report_skip("edu device has neither MSI nor MSI-X");
+		return report_summary();
+	}
+
+	dma_buf = alloc_page();
+	assert(dma_buf);
+	handle_irq(EDU_VECTOR, edu_isr);
+
+	hz = tsc_hz();
+	gap = hz * gap_us / 1000000;
+	timeout = hz ? hz * TIMEOUT_MS / 1000 : TIMEOUT;
+	if (gap_us && !hz)
+		report_info("unknown TSC frequency, ignoring gap");
+	printf("%d cpus, %s, TSC frequency %" PRIu64 " Hz\n", cpu_count(),
+	       msix ? "MSI-X" : "MSI", hz);
+
+	run_all(false);
+	if (dma_samples)
+		run_all(true);
+
+	return report_summary();
+}
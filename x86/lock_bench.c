@@ -0,0 +1,18 @@
+/*
+ * Spinlock contention benchmark, see lib/lock_bench.h.
+ *
+ * On x86 the locks spin with PAUSE, and with "-nopause" without it, so
+ * that no pause-loop exits are taken.  Times are in TSC cycles.
+ *
+ * usage: lock_bench.flat [--json|--csv] [--pause|--nopause] [tas|ticket|mcs...]
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "lock_bench.h"
+#include "smp.h"
+
+int main(int ac, char **av)
+{
+	return lock_bench_main("lock_bench", cpu_count(), ac, av);
+}
@@ -0,0 +1,125 @@
+/*
+ * Selftest of the object caches of lib/slab.c.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "alloc_page.h"
+#include "slab.h"
+#include "vmalloc.h"
+
+#define NR_SLABS	3
+#define MAX_OBJS	(NR_SLABS * PAGE_SIZE / sizeof(void *))
+
+static void *objs[MAX_OBJS];
+
+static void fill(void *obj, size_t size, unsigned int i)
+{
+	memset(obj, i & 0xff, size);
+}
+
+static bool check(void *obj, size_t size, unsigned int i)
+{
+	u8 *p = obj;
+	size_t j;
+
+	for (j = 0; j < size; j++)
+		if (p[j] != (i & 0xff))
+			return false;
+	return true;
+}
+
+static void test_alloc_free(void)
+{
+	struct kmem_cache_stats s;
+	struct kmem_cache *cache;
+	unsigned int i, n;
+	bool ok = true;
+	void *obj;
+
+	report_prefix_push("alloc/free");
+
+	cache = kmem_cache_create("slab-test", 24, 0, 0);
+	assert(cache);
+	kmem_cache_get_stats(cache, &s);
+	report(s.obj_size >= 24 && s.objs_per_slab >= 8, "%lu objects of %lu bytes per slab",
+	       s.objs_per_slab, s.obj_size);
+
+	n = NR_SLABS * s.objs_per_slab;
+	assert(n <= MAX_OBJS);
+	for (i = 0; i < n; i++) {
+		objs[i] = kmem_cache_alloc(cache);
+		if (!objs[i]) {
+			ok = false;
+			break;
+		}
+		fill(objs[i], 24, i);
+	}
+	report(ok, "%u allocations", n);
+	for (i = 0; ok && i < n; i++)
+		ok = check(objs[i], 24, i);
+	report(ok, "objects do not overlap");
+
+	kmem_cache_get_stats(cache, &s);
+	report(s.active == n && s.peak == n && s.allocs == n && s.slabs == NR_SLABS,
+	       "stats after allocation");
+
+	obj = objs[n / 2];
+	kmem_cache_free(cache, obj);
+	objs[n / 2] = kmem_cache_alloc(cache);
+	report(objs[n / 2] == obj, "freed object is reused");
+
+	fill(objs[0], 24, 0xff);
+	kmem_cache_free(cache, objs[0]);
+	objs[0] = kmem_cache_zalloc(cache);
+	report(objs[0] && check(objs[0], 24, 0), "zalloc zeroes the object");
+
+	for (i = 0; i < n; i++)
+		kmem_cache_free(cache, objs[i]);
+	kmem_cache_get_stats(cache, &s);
+	report(!s.active && s.peak == n && s.frees == n + 2 && s.slabs == 1,
+	       "stats after free, one spare slab");
+
+	kmem_cache_print_stats(cache);
+	kmem_cache_destroy(cache);
+
+	report_prefix_pop();
+}
+
+static void test_align(void)
+{
+	struct kmem_cache *cache;
+	unsigned int i;
+	bool ok = true;
+
+	report_prefix_push("align");
+
+	cache = kmem_cache_create("slab-align", 40, 64, 0);
+	assert(cache);
+	for (i = 0; i < 16; i++) {
+		objs[i] = kmem_cache_alloc(cache);
+		ok = ok && objs[i] && IS_ALIGNED((uintptr_t)objs[i], 64);
+	}
+	report(ok, "objects are 64 byte aligned");
+	for (i = 0; i < 16; i++)
+		kmem_cache_free(cache, objs[i]);
+	kmem_cache_destroy(cache);
+
+	report(!kmem_cache_create("slab-huge", 8 * PAGE_SIZE, 0, 0),
+	       "objects larger than a slab are refused");
+
+	report_prefix_pop();
+}
+
+int main(void)
+{
+	setup_vm();
+
+	report_prefix_push("slab");
+	test_alloc_free();
+	test_align();
+	kmem_cache_print_stats(NULL);
+	report_prefix_pop();
+
+	return report_summary();
+}
@@ -410,7 +410,7 @@ int main(int ac, char **av)
 {
 	/* Omit PT_USER_MASK to allow tested host.CR4.SMEP=1. */
 	pteval_t opt_mask = 0;
-	int i = 0;
+	int i;
 
 	ac--;
 	av++;
@@ -426,25 +426,28 @@ int main(int ac, char **av)
 
 	vmcb = alloc_page();
 
-	for (; svm_tests[i].name != NULL; i++) {
-		if (!test_wanted(svm_tests[i].name, av, ac))
-			continue;
-		if (svm_tests[i].supported && !svm_tests[i].supported())
-			continue;
-		if (svm_tests[i].v2 == NULL) {
-			if (svm_tests[i].on_vcpu) {
-				if (cpu_count() <= svm_tests[i].on_vcpu)
-					continue;
-				on_cpu_async(svm_tests[i].on_vcpu, (void *)test_run, &svm_tests[i]);
-				while (!svm_tests[i].on_vcpu_done)
-					cpu_relax();
+	while (report_batch_next(&ac, (const char ***)&av)) {
+		for (i = 0; svm_tests[i].name != NULL; i++) {
+			if (!test_wanted(svm_tests[i].name, av, ac))
+				continue;
+			if (svm_tests[i].supported && !svm_tests[i].supported())
+				continue;
+			if (svm_tests[i].v2 == NULL) {
+				if (svm_tests[i].on_vcpu) {
+					if (cpu_count() <= svm_tests[i].on_vcpu)
+						continue;
+					svm_tests[i].on_vcpu_done = false;
+					on_cpu_async(svm_tests[i].on_vcpu, (void *)test_run, &svm_tests[i]);
+					while (!svm_tests[i].on_vcpu_done)
+						cpu_relax();
+				}
+				else
+					test_run(&svm_tests[i]);
+			} else {
+				vmcb_ident(vmcb);
+				v2_test = &(svm_tests[i]);
+				svm_tests[i].v2();
 			}
-			else
-				test_run(&svm_tests[i]);
-		} else {
-			vmcb_ident(vmcb);
-			v2_test = &(svm_tests[i]);
-			svm_tests[i].v2();
 		}
 	}
 
@@ -21,12 +21,15 @@
  */
 
 #include "libcflat.h"
+#include "bench.h"
+#include "histogram.h"
 #include "apic.h"
 #include "vm.h"
 #include "smp.h"
 #include "desc.h"
 #include "isr.h"
 #include "msr.h"
+#include "delay.h"
 
 static void test_lapic_existence(void)
 {
@@ -47,6 +50,7 @@ u64 table[TABLE_SIZE];
 volatile int table_idx;
 volatile int hitmax = 0;
 int breakmax = 0;
+struct histogram hist;
 
 static void tsc_deadline_timer_isr(isr_regs_t *regs)
 {
@@ -100,6 +104,30 @@ static void test_tsc_deadline_timer(void)
     }
 }
 
+static void emit_latency(void)
+{
+    struct bench_result r = {
+        .suite = "tscdeadline_latency",
+        .name = "latency",
+        .cpu = -1,
+        .hist = &hist,
+    };
+    int i;
+
+    /* Keep the still running deadline timer out of the calibration. */
+    irq_disable();
+    hist_init(&hist);
+    for (i = 0; i < table_idx; i++)
+        hist_add(&hist, table[i]);
+    hist_print("latency", &hist);
+
+    r.iterations = hist.count;
+    r.ticks = hist.sum;
+    if (bench_get_format() != BENCH_FMT_TEXT)
+        r.freq = tsc_hz();
+    bench_emit(&r);
+}
+
 int main(int argc, char **argv)
 {
     int i, size;
@@ -126,6 +154,7 @@ int main(int argc, char **argv)
             printf("hit max: %d < ", breakmax);
         printf("latency: %" PRId64 "\n", table[i]);
     }
+    emit_latency();
 
     return report_summary();
 }
@@ -0,0 +1,297 @@
+/*
+ * Multiqueue virtio notification and interrupt scaling benchmark.
+ *
+ * Binds request queue i of a virtio-blk-pci disk to CPU i, with the
+ * queue's MSI-X entry routed to that CPU, and lets the first 1, 2, 4,
+ * ... and finally all bound CPUs drive their queues concurrently, one
+ * 512 byte read at a time, for a fixed time in each of two modes:
+ *
+ *  - poll: completion interrupts are suppressed and each CPU busy-polls
+ *    its used ring;
+ *  - irq:  each CPU waits for its completion interrupt.
+ *
+ * For each it reports the cost of the notification (the MMIO write that
+ * exits to the host's ioeventfd), the request latency from notification
+ * to the guest seeing the completion, and the aggregate requests per
+ * second.  The difference between the irq and poll latencies is the
+ * cost of interrupt injection.  Use a null backend, as unittests.cfg
+ * does, so that the numbers are dominated by virtio rather than the
+ * block layer.  Times are in TSC cycles.
+ *
+ * A queue whose completion interrupt does not come fails its step.  It
+ * is drained before the next one, and fails every step it is part of
+ * for as long as its request stays in flight.
+ *
+ * usage: virtio_mq_bench.flat [--json|--csv] [ms=N]
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.
+ */
+#include "libcflat.h"
+#include "alloc.h"
+#include "alloc_page.h"
+#include "apic.h"
+#include "bench.h"
+#include "delay.h"
+#include "histogram.h"
+#include "isr.h"
+#include "processor.h"
+#include "smp.h"
+#include "vmalloc.h"
+#include "virtio.h"
+#include "virtio-blk.h"
+#include "virtio-pci.h"
+
+#define VQ_VECTOR	0x60
+#define DURATION_MS	200
+#define DURATION	(1ull << 28)	/* TSC cycles, if tsc_hz() is unknown */
+
+struct worker {
+	struct virtqueue *vq;
+	struct virtio_blk_req *req;
+	void *buf;
+	volatile u64 irq_tsc;		/* set by the completion interrupt */
+	u64 irqs;
+	u64 errors;
+	bool lost;			/* a completion interrupt never came */
+	struct histogram kick;		/* cycles of the notifying write */
+	struct histogram lat;		/* cycles from notification to completion */
+} __attribute__((aligned(64)));
+
+static struct virtio_blk *blk;
+static struct worker *workers;
+static int nr_cpus, nr_workers;
+static u64 hz, duration;
+
+static bool cur_irq;
+
+static void vq_isr(isr_regs_t *regs)
+{
+	struct worker *w = &workers[smp_cpu_index()];
+
+	w->irq_tsc = rdtsc();
+	w->irqs++;
+	eoi();
+}
+
+static bool one_request(struct worker *w, bool irq, u64 deadline)
+{
+	unsigned int len;
+	u64 t0, t1;
+
+	w->irq_tsc = 0;
+	if (virtio_blk_submit_vq(w->vq, w->req, VIRTIO_BLK_T_IN, 0, w->buf,
+				 VIRTIO_BLK_SECTOR_SIZE) < 0)
+		return false;
+
+	t0 = rdtsc();
+	if (virtqueue_kick_prepare(w->vq)) {
+		virtqueue_notify(w->vq);
+		t1 = rdtsc();
+		hist_add(&w->kick, t1 - t0);
+	}
+
+	if (irq) {
+		/*
+		 * A request may be in flight at the deadline, so allow it
+		 * another period before declaring the interrupt lost.
+		 */
+		while (!w->irq_tsc) {
+			if (rdtsc() >= deadline + duration) {
+				w->lost = true;
+				return false;
+			}
+			pause();
+		}
+		hist_add(&w->lat, w->irq_tsc - t0);
+		if (!virtqueue_get_buf(w->vq, &len))
+			return false;
+	} else {
+		virtqueue_wait_buf(w->vq, &len);
+		hist_add(&w->lat, rdtsc() - t0);
+	}
+
+	return w->req->status == VIRTIO_BLK_S_OK;
+}
+
+/*
+ * A queue whose completion interrupt got lost may still have its request
+ * in flight.  Wait for it on the used ring, with interrupts off, so that
+ * the queue takes part in the next run again.
+ */
+static bool drain(struct worker *w)
+{
+	unsigned int len;
+	u64 end = rdtsc() + duration;
+
+	while (!virtqueue_get_buf(w->vq, &len)) {
+		if (rdtsc() >= end)
+			return false;
+		pause();
+	}
+
+	w->lost = false;
+	return true;
+}
+
+static void bench_loop(void *data)
+{
+	struct worker *w = &workers[smp_cpu_index()];
+	bool irq = cur_irq;
+	u64 deadline;
+
+	hist_init(&w->kick);
+	hist_init(&w->lat);
+	w->irqs = 0;
+	w->errors = 0;
+
+	/* A queue that is still stuck fails every run it is part of */
+	if (w->lost && !drain(w))
+		w->errors++;
+
+	if (irq) {
+		virtqueue_enable_cb(w->vq);
+		irq_enable();
+	} else {
+		virtqueue_disable_cb(w->vq);
+	}
+
+	deadline = bench_wait_start(duration);
+
+	/* The request of a lost interrupt may still be in the queue */
+	while (!w->lost && rdtsc() < deadline)
+		if (!one_request(w, irq, deadline) && ++w->errors > 100)
+			break;
+
+	irq_disable();
+	virtqueue_disable_cb(w->vq);
+}
+
+static void run(bool irq, int ncpus, u64 *p50)
+{
+	struct histogram kick, lat;
+	u64 errors = 0, irqs = 0;
+	char kick_name[32], lat_name[32];
+	int i;
+
+	snprintf(kick_name, sizeof(kick_name), "kick-%s@%d",
+		 irq ? "irq" : "poll", ncpus);
+	snprintf(lat_name, sizeof(lat_name), "lat-%s@%d",
+		 irq ? "irq" : "poll", ncpus);
+
+	cur_irq = irq;
+	bench_run_on_first_cpus(ncpus, bench_loop, NULL);
+
+	hist_init(&kick);
+	hist_init(&lat);
+	for (i = 0; i < ncpus; ++i) {
+		hist_merge(&kick, &workers[i].kick);
+		hist_merge(&lat, &workers[i].lat);
+		errors += workers[i].errors;
+		irqs += workers[i].irqs;
+		if (workers[i].lost)
+			report_info("queue %d on cpu %d never got its completion interrupt",
+				    workers[i].vq->index, i);
+	}
+
+	report(!errors && lat.count && (!irq || irqs >= lat.count),
+	       "%s %d queues", irq ? "irq" : "poll", ncpus);
+
+	printf("  %s@%d", irq ? "irq" : "poll", ncpus);
+	if (hz)
+		printf(" requests/s %" PRIu64, lat.count * hz / duration);
+	printf(" kicks %" PRIu64 " interrupts %" PRIu64 "\n", kick.count, irqs);
+	hist_print(kick_name, &kick);
+	hist_print(lat_name, &lat);
+	*p50 = hist_permille(&lat, 500);
+
+	if (bench_get_format() == BENCH_FMT_TEXT)
+		return;
+
+	bench_emit_hist("virtio_mq_bench", kick_name, -1, &kick, hz);
+	bench_emit_hist("virtio_mq_bench", lat_name, -1, &lat, hz);
+	for (i = 0; ncpus > 1 && i < ncpus; ++i) {
+		bench_emit_hist("virtio_mq_bench", kick_name, i,
+				&workers[i].kick, hz);
+		bench_emit_hist("virtio_mq_bench", lat_name, i,
+				&workers[i].lat, hz);
+	}
+}
+
+static bool setup_workers(void)
+{
+	struct virtio_pci_device *vp_dev;
+	struct worker *w;
+	u8 *pages;
+	int i;
+
+	vp_dev = to_virtio_pci_device(blk->vdev);
+	if (!vp_dev->msix) {
+		report_skip("virtio-blk has too few MSI-X vectors");
+		return false;
+	}
+
+	nr_workers = MIN(nr_cpus, blk->nr_queues);
+	workers = calloc(nr_workers, sizeof(*workers));
+	assert(workers);
+
+	handle_irq(VQ_VECTOR, vq_isr);
+
+	for (i = 0; i < nr_workers; ++i) {
+		w = &workers[i];
+		w->vq = blk->vqs[i];
+		virtqueue_disable_cb(w->vq);
+
+		/* Requests and buffers are handed to the device by address */
+		pages = alloc_page();
+		assert(pages);
+		w->req = (void *)pages;
+		w->buf = pages + PAGE_SIZE / 2;
+
+		pci_setup_msix(&vp_dev->pci_dev, virtio_pci_vq_msix_entry(w->vq),
+			       APIC_DEFAULT_PHYS_BASE | (id_map[i] << 12), VQ_VECTOR);
+	}
+
+	return true;
+}
+
+int main(int ac, char **av)
+{
+	u64 poll_p50, irq_p50;
+	long ms = DURATION_MS;
+	int i, n;
+
+	setup_vm();
+	nr_cpus = cpu_count();
+
+	for (i = 1; i < ac; ++i) {
+		if (bench_parse_arg(av[i]))
+			continue;
+		if (strncmp(av[i], "ms=", 3) == 0 && (ms = atol(av[i] + 3)) > 0)
+			continue;
+		report_abort("unknown argument '%s'", av[i]);
+	}
+
+	blk = virtio_blk_bind_queues(nr_cpus);
+	if (!blk) {
+		report_skip("no virtio-blk device");
+		return report_summary();
+	}
+
+	if (!setup_workers())
+		return report_summary();
+
+	hz = tsc_hz();
+	duration = hz ? hz * ms / 1000 : DURATION;
+	printf("%d cpus, %d queues, TSC frequency %" PRIu64 " Hz\n",
+	       nr_cpus, nr_workers, hz);
+
+	for (n = 1; ; n = MIN(n * 2, nr_workers)) {
+		run(false, n, &poll_p50);
+		run(true, n, &irq_p50);
+		printf("  irq-cost@%d p50 %" PRId64 "\n", n, (s64)(irq_p50 - poll_p50));
+		if (n == nr_workers)
+			break;
+	}
+
+	return report_summary();
+}
@@ -1,4 +1,7 @@
 #include "libcflat.h"
+#include "alloc.h"
+#include "bench.h"
+#include "histogram.h"
 #include "smp.h"
 #include "pci.h"
 #include "x86/vm.h"
@@ -6,6 +9,7 @@
 #include "x86/acpi.h"
 #include "x86/apic.h"
 #include "x86/isr.h"
+#include "x86/delay.h"
 
 #define IPI_TEST_VECTOR	0xb0
 
@@ -20,6 +24,7 @@ struct test {
 #define GOAL (1ull << 30)
 
 static int nr_cpus;
+static int nr_test_cpus;	/* CPUs running the current parallel test */
 
 static void cpuid_test(void)
 {
@@ -250,7 +255,7 @@ static void ple_round_robin(void)
 
 	p->n2 = p->n1;
 	you = me + 1;
-	if (you == nr_cpus)
+	if (you == nr_test_cpus)
 		you = 0;
 	++counters[you].n1;
 }
@@ -498,22 +503,179 @@ static struct test tests[] = {
 
 unsigned iterations;
 
+/*
+ * With --hist every iteration is timed individually and recorded in a
+ * per-CPU histogram, so that the tail of the exit cost distribution is
+ * reported in addition to the mean.
+ */
+static bool hist_mode;
+static bool scale_mode;
+static struct histogram *cpu_hist;
+static u64 tsc_overhead;
+
+static void measure_tsc_overhead(void)
+{
+	u64 t1, t2;
+	int i;
+
+	tsc_overhead = ~0ULL;
+	for (i = 0; i < 1000; ++i) {
+		t1 = rdtsc();
+		t2 = rdtsc();
+		if (t2 - t1 < tsc_overhead)
+			tsc_overhead = t2 - t1;
+	}
+}
+
+static void run_iterations(void (*func)(void))
+{
+	struct histogram *h;
+	u64 t1, t2;
+	int i;
+
+	if (!hist_mode) {
+		for (i = 0; i < iterations; ++i)
+			func();
+		return;
+	}
+
+	h = &cpu_hist[smp_cpu_index()];
+	hist_init(h);
+	for (i = 0; i < iterations; ++i) {
+		t1 = rdtsc();
+		func();
+		t2 = rdtsc() - t1;
+		hist_add(h, t2 > tsc_overhead ? t2 - tsc_overhead : 0);
+	}
+}
+
 static void run_test(void *_func)
 {
-    int i;
-    void (*func)(void) = _func;
+	run_iterations(_func);
+}
 
-    for (i = 0; i < iterations; ++i)
-        func();
+static void emit_result(struct test *test, const char *suffix, int cpu,
+			u64 nr, u64 ticks, const struct histogram *hist)
+{
+	struct bench_result r = {
+		.suite = "vmexit",
+		.cpu = cpu,
+		.iterations = nr,
+		.ticks = ticks,
+		.freq = tsc_hz(),
+		.hist = hist,
+	};
+	char name[64];
+
+	/* Tests with a next() callback run several sub-tests. */
+	if (test->next)
+		snprintf(name, sizeof(name), "%s.%d%s", test->name,
+			 pci_test.test_idx, suffix);
+	else
+		snprintf(name, sizeof(name), "%s%s", test->name, suffix);
+	r.name = name;
+
+	bench_emit(&r);
 }
 
-static bool do_test(struct test *test)
+static void report_results(struct test *test, u64 ticks)
 {
+	struct histogram total, *hist = NULL;
+	char name[64];
 	int i;
+
+	if (hist_mode && !test->parallel) {
+		hist = &cpu_hist[smp_cpu_index()];
+		hist_print(test->name, hist);
+	} else if (hist_mode) {
+		hist = &total;
+		hist_init(hist);
+		for (i = 0; i < nr_cpus; ++i)
+			hist_merge(hist, &cpu_hist[i]);
+		hist_print(test->name, hist);
+
+		for (i = 0; nr_cpus > 1 && i < nr_cpus; ++i) {
+			snprintf(name, sizeof(name), "  cpu%d %s", i, test->name);
+			hist_print(name, &cpu_hist[i]);
+		}
+	}
+
+	if (bench_get_format() == BENCH_FMT_TEXT)
+		return;
+
+	emit_result(test, "", -1, iterations, ticks, hist);
+	for (i = 0; hist_mode && test->parallel && nr_cpus > 1 && i < nr_cpus; ++i)
+		emit_result(test, "", i, cpu_hist[i].count, cpu_hist[i].sum,
+			    &cpu_hist[i]);
+	if (tsc_ipi)
+		emit_result(test, ".ipi", -1, iterations, tsc_ipi, NULL);
+	if (tsc_eoi)
+		emit_result(test, ".eoi", -1, iterations, tsc_eoi, NULL);
+}
+
+static unsigned long long time_test(struct test *test, void (*func)(void),
+				    int ncpus)
+{
 	unsigned long long t1, t2;
-        void (*func)(void);
 
-        iterations = 32;
+	iterations = 32;
+	nr_test_cpus = ncpus;
+
+	do {
+		tsc_eoi = tsc_ipi = 0;
+		iterations *= 2;
+		t1 = rdtsc();
+
+		if (!test->parallel) {
+			run_iterations(func);
+		} else if (ncpus == nr_cpus) {
+			on_cpus(run_test, func);
+		} else {
+			bench_run_on_first_cpus(ncpus, run_test, func);
+		}
+		t2 = rdtsc();
+	} while ((t2 - t1) < GOAL);
+
+	nr_test_cpus = nr_cpus;
+	return t2 - t1;
+}
+
+/*
+ * With --scale, parallel tests are repeated on 1, 2, 4, ... and finally
+ * all CPUs, printing the cost per iteration on each CPU and the number
+ * of iterations per second summed over all of them.  Host-side
+ * contention shows up as a per-CPU cost that grows with the CPU count.
+ */
+static void scale_test(struct test *test, void (*func)(void))
+{
+	unsigned long long ticks;
+	u64 hz = tsc_hz();
+	char suffix[16];
+	int n;
+
+	for (n = 1; ; n = MIN(n * 2, nr_cpus)) {
+		ticks = time_test(test, func, n);
+		printf("  scale %s cpus %d per-cpu %d", test->name, n,
+		       (int)(ticks / iterations));
+		if (hz)
+			printf(" aggregate %" PRIu64 "/s",
+			       bench_rate((u64)iterations * n, ticks, hz));
+		printf("\n");
+
+		if (bench_get_format() != BENCH_FMT_TEXT) {
+			snprintf(suffix, sizeof(suffix), "@%d", n);
+			emit_result(test, suffix, -1, iterations, ticks, NULL);
+		}
+
+		if (n == nr_cpus)
+			break;
+	}
+}
+
+static bool do_test(struct test *test)
+{
+	unsigned long long ticks;
+        void (*func)(void);
 
         if (test->valid && !test->valid()) {
 		printf("%s (skipped)\n", test->name);
@@ -530,25 +692,17 @@ static bool do_test(struct test *test)
 		return false;
 	}
 
-	do {
-		tsc_eoi = tsc_ipi = 0;
-		iterations *= 2;
-		t1 = rdtsc();
-
-		if (!test->parallel) {
-			for (i = 0; i < iterations; ++i)
-				func();
-		} else {
-			on_cpus(run_test, func);
-		}
-		t2 = rdtsc();
-	} while ((t2 - t1) < GOAL);
-	printf("%s %d\n", test->name, (int)((t2 - t1) / iterations));
+	ticks = time_test(test, func, nr_cpus);
+	printf("%s %d\n", test->name, (int)(ticks / iterations));
+	report_results(test, ticks);
 	if (tsc_ipi)
 		printf("  ipi %s %d\n", test->name, (int)(tsc_ipi / iterations));
 	if (tsc_eoi)
 		printf("  eoi %s %d\n", test->name, (int)(tsc_eoi / iterations));
 
+	if (scale_mode && test->parallel && nr_cpus > 1)
+		scale_test(test, func);
+
 	return test->next;
 }
 
@@ -574,14 +728,34 @@ static bool test_wanted(struct test *test, char *wanted[], int nwanted)
 
 int main(int ac, char **av)
 {
-	int i;
+	int i, nwanted = 0;
 	unsigned long membar = 0;
 	struct pci_dev pcidev;
 	int ret;
 
 	setup_vm();
 	handle_irq(IPI_TEST_VECTOR, self_ipi_isr);
-	nr_cpus = cpu_count();
+	nr_cpus = nr_test_cpus = cpu_count();
+
+	/* Strip options from the argument list, the rest are test names. */
+	for (i = 1; i < ac; ++i) {
+		if (strcmp(av[i], "--hist") == 0)
+			hist_mode = true;
+		else if (strcmp(av[i], "--scale") == 0)
+			scale_mode = true;
+		else if (!bench_parse_arg(av[i]))
+			av[++nwanted] = av[i];
+	}
+
+	if (hist_mode) {
+		cpu_hist = calloc(nr_cpus, sizeof(*cpu_hist));
+		assert(cpu_hist);
+		measure_tsc_overhead();
+		printf("rdtsc overhead %" PRIu64 " (subtracted)\n", tsc_overhead);
+	}
+
+	if (bench_get_format() != BENCH_FMT_TEXT)
+		printf("TSC frequency %" PRIu64 " Hz\n", tsc_hz());
 
 	irq_enable();
 	on_cpus(enable_nx, NULL);
@@ -599,7 +773,7 @@ int main(int ac, char **av)
 	}
 
 	for (i = 0; i < ARRAY_SIZE(tests); ++i)
-		if (test_wanted(&tests[i], av + 1, ac - 1))
+		if (test_wanted(&tests[i], av + 1, nwanted))
 			while (do_test(&tests[i])) {}
 
 	return 0;
@@ -38,6 +38,7 @@
 #include "msr.h"
 #include "smp.h"
 #include "apic.h"
+#include "snapshot.h"
 
 u64 *bsp_vmxon_region;
 struct vmcs *vmcs_root;
@@ -923,11 +924,12 @@ static void split_large_ept_entry(unsigned long *ptep, int level)
 		@pte : pte value to set
 		@pt_page : address of page table, NULL for a new page
  */
-void install_ept_entry(unsigned long *pml4,
-		int pte_level,
-		unsigned long guest_addr,
-		unsigned long pte,
-		unsigned long *pt_page)
+static void __install_ept_entry(unsigned long *pml4,
+				int pte_level,
+				unsigned long guest_addr,
+				unsigned long pte,
+				unsigned long *pt_page,
+				struct pt_pool *pool)
 {
 	int level;
 	unsigned long *pt = pml4;
@@ -941,11 +943,14 @@ void install_ept_entry(unsigned long *pml4,
 				& EPT_PGDIR_MASK;
 		if (!(pt[offset] & (EPT_PRESENT))) {
 			unsigned long *new_pt = pt_page;
-			if (!new_pt)
-				new_pt = alloc_page();
-			else
+			if (new_pt) {
 				pt_page = 0;
-			memset(new_pt, 0, PAGE_SIZE);
+				memset(new_pt, 0, PAGE_SIZE);
+			} else if (pool) {
+				new_pt = pt_pool_get(pool);
+			} else {
+				new_pt = alloc_page();
+			}
 			pt[offset] = virt_to_phys(new_pt)
 					| EPT_RA | EPT_WA | EPT_EA;
 		} else if (pt[offset] & EPT_LARGE_PAGE)
@@ -956,6 +961,15 @@ void install_ept_entry(unsigned long *pml4,
 	pt[offset] = pte;
 }
 
+void install_ept_entry(unsigned long *pml4,
+		int pte_level,
+		unsigned long guest_addr,
+		unsigned long pte,
+		unsigned long *pt_page)
+{
+	__install_ept_entry(pml4, pte_level, guest_addr, pte, pt_page, NULL);
+}
+
 /* Map a page, @perm is the permission of the page */
 void install_ept(unsigned long *pml4,
 		unsigned long phys,
@@ -997,23 +1011,37 @@ void setup_ept_range(unsigned long *pml4, unsigned long start,
 {
 	u64 phys = start;
 	u64 max = (u64)len + (u64)start;
+	int level = map_1g ? 3 : map_2m ? 2 : 1;
+	struct pt_pool pool;
+
+	/*
+	 * Page tables come from a pool filled in bulk; size it for the
+	 * tables below the largest pages used, plus a few for the edges.
+	 */
+	pt_pool_init(&pool, (len >> EPT_LEVEL_SHIFT(level + 1)) + 2 * EPT_PAGE_LEVEL);
 
 	if (map_1g) {
 		while (phys + PAGE_SIZE_1G <= max) {
-			install_1g_ept(pml4, phys, phys, perm);
+			__install_ept_entry(pml4, 3, phys,
+					    (phys & PAGE_MASK) | perm | EPT_LARGE_PAGE,
+					    0, &pool);
 			phys += PAGE_SIZE_1G;
 		}
 	}
 	if (map_2m) {
 		while (phys + PAGE_SIZE_2M <= max) {
-			install_2m_ept(pml4, phys, phys, perm);
+			__install_ept_entry(pml4, 2, phys,
+					    (phys & PAGE_MASK) | perm | EPT_LARGE_PAGE,
+					    0, &pool);
 			phys += PAGE_SIZE_2M;
 		}
 	}
 	while (phys + PAGE_SIZE <= max) {
-		install_ept(pml4, phys, phys, perm);
+		__install_ept_entry(pml4, 1, phys, (phys & PAGE_MASK) | perm,
+				    0, &pool);
 		phys += PAGE_SIZE;
 	}
+	pt_pool_release(&pool);
 }
 
 /* get_ept_pte : Get the PTE of a given level in EPT,
@@ -1278,8 +1306,9 @@ static void init_vmcs_host(void)
 	vmcs_write(HOST_BASE_TR, tss_descr.base);
 	vmcs_write(HOST_BASE_GDTR, gdt64_desc.base);
 	vmcs_write(HOST_BASE_IDTR, idt_descr.base);
-	vmcs_write(HOST_BASE_FS, 0);
-	vmcs_write(HOST_BASE_GS, 0);
+	/* GS holds the per-cpu area, see smp_id() */
+	vmcs_write(HOST_BASE_FS, rdmsr(MSR_FS_BASE));
+	vmcs_write(HOST_BASE_GS, rdmsr(MSR_GS_BASE));
 
 	/* Set other vmcs area */
 	vmcs_write(PF_ERROR_MASK, 0);
@@ -2092,7 +2121,7 @@ test_wanted(const char *name, const char *filters[], int filter_count)
 
 int main(int argc, const char *argv[])
 {
-	int i = 0;
+	int i;
 
 	setup_vm();
 	hypercall_field = 0;
@@ -2100,6 +2129,9 @@ int main(int argc, const char *argv[])
 	/* We want xAPIC mode to test MMIO passthrough from L1 (us) to L2.  */
 	smp_reset_apic();
 
+	/* The vmx tests differ only in their arguments, restart them here. */
+	snapshot_point(&argc);
+
 	argv++;
 	argc--;
 
@@ -2149,11 +2181,14 @@ int main(int argc, const char *argv[])
 	/* Balance vmxon from test_vmxon. */
 	vmx_off();
 
-	for (; vmx_tests[i].name != NULL; i++) {
-		if (!test_wanted(vmx_tests[i].name, argv, argc))
-			continue;
-		if (test_run(&vmx_tests[i]))
-			goto exit;
+	/* The tests above run once, with the arguments of the whole batch. */
+	while (report_batch_next(&argc, &argv)) {
+		for (i = 0; vmx_tests[i].name != NULL; i++) {
+			if (!test_wanted(vmx_tests[i].name, argv, argc))
+				continue;
+			if (test_run(&vmx_tests[i]))
+				goto exit;
+		}
 	}
 
 	if (!matched)